@@ -0,0 +1,408 @@
+// Throughput benchmark for the IPC layer, driven against the shared-memory
+// FSUIPC emulator so results are reproducible without a sim.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ChangeTracker.h"
+#include "Cycle.h"
+#include "IPCUser.h"
+#include "Poller.h"
+#include "ReadPlan.h"
+#include "Registry.h"
+#include "RetryPolicy.h"
+#include "ShmTransport.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "WriteBatch.h"
+#include "WriteInbox.h"
+#include "WriteQueue.h"
+
+using namespace FSUIPC;
+
+struct Options {
+  int reads = 1000;
+  int writes = 200;
+  int cycles = 10000;
+  unsigned int latency = 0;
+  unsigned int seed = 42;
+  int gap = -1;  // Coalesce reads through ReadPlan when >= 0
+  int changes = 0;  // Track changed offsets after each cycle
+  int poll = 0;     // Run cycles on a Poller with this interval in us
+  int repeat = 1;   // Times each write is queued per cycle
+  int batch = 0;    // Queue writes by pushing a writeBatch() buffer
+  int trace = 0;    // Trace cycles and write them to fsuipc-trace.json
+  int timeout = 0;   // Attempt timeout in ms, latencies above it time out
+  int deadline = 0;  // Give up cycles that take longer than this in ms
+  int views = 2;     // IPC views to pipeline transactions over
+  int bits = 0;      // Masked writes to read offsets queued per cycle
+};
+
+struct Request {
+  DWORD offset;
+  DWORD size;
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    int value = atoi(argv[++i]);
+    if (arg == "--reads") {
+      options->reads = value;
+    } else if (arg == "--writes") {
+      options->writes = value;
+    } else if (arg == "--cycles") {
+      options->cycles = value;
+    } else if (arg == "--latency") {
+      options->latency = value;
+    } else if (arg == "--seed") {
+      options->seed = value;
+    } else if (arg == "--gap") {
+      options->gap = value;
+    } else if (arg == "--changes") {
+      options->changes = value;
+    } else if (arg == "--poll") {
+      options->poll = value;
+    } else if (arg == "--repeat") {
+      options->repeat = value;
+    } else if (arg == "--batch") {
+      options->batch = value;
+    } else if (arg == "--trace") {
+      options->trace = value;
+    } else if (arg == "--timeout") {
+      options->timeout = value;
+    } else if (arg == "--deadline") {
+      options->deadline = value;
+    } else if (arg == "--views") {
+      options->views = value;
+    } else if (arg == "--bits") {
+      options->bits = value;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Offsets with the mix of sizes a typical dashboard registers, kept clear of
+// the version offsets at 0x3304..0x330B
+static std::vector<Request> MakeRequests(std::mt19937& rng, int count) {
+  static const DWORD sizes[] = {1, 2, 4, 4, 4, 8, 8};
+  std::uniform_int_distribution<int> sizeDist(0, 6);
+  std::uniform_int_distribution<DWORD> offsetDist(0x4000, 0xFF00);
+
+  std::vector<Request> requests;
+  for (int i = 0; i < count; i++) {
+    DWORD size = sizes[sizeDist(rng)];
+    requests.push_back(Request{offsetDist(rng) & ~(size - 1), size});
+  }
+  return requests;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  Error result;
+
+  if (!ParseOptions(argc, argv, &options)) {
+    fprintf(stderr,
+            "usage: fsuipc_bench [--reads N] [--writes N] [--cycles N] "
+            "[--latency us] [--seed N] [--gap bytes] [--changes 0|1] "
+            "[--poll us] [--repeat N] [--batch 0|1] [--trace 0|1] "
+            "[--timeout ms] [--deadline ms] [--views N] [--bits N]\n");
+    return 2;
+  }
+
+  if (options.views < 1) {
+    fprintf(stderr, "views: must be at least 1\n");
+    return 2;
+  }
+
+  ShmTransport* transport = new ShmTransport(options.latency, options.views);
+  IPCUser ipc(transport);
+  Stats stats;
+  Tracer tracer;
+
+  if (!ipc.Open(Simulator::ANY, &result)) {
+    fprintf(stderr, "open: %s\n", ErrorToString(result));
+    return 1;
+  }
+
+  // Only time the cycles, not the version check of Open()
+  ipc.SetStats(&stats);
+  ipc.SetTracer(&tracer);
+  if (options.trace) {
+    tracer.Start(65536);
+  }
+
+  RetryPolicy policy;
+  if (options.timeout > 0) {
+    policy.attemptTimeout = std::chrono::milliseconds(options.timeout);
+  }
+  auto applyDeadline = [&] {
+    if (options.deadline > 0) {
+      policy.deadline = RetryPolicy::Clock::now() +
+                        std::chrono::milliseconds(options.deadline);
+    }
+    ipc.SetRetryPolicy(policy);
+  };
+  applyDeadline();
+
+  std::mt19937 rng(options.seed);
+  BYTE* table = transport->Table();
+  for (DWORD i = 0x4000; i < SHM_TABLE_SIZE; i++) {
+    table[i] = (BYTE)rng();
+  }
+
+  std::vector<Request> reads = MakeRequests(rng, options.reads);
+  std::vector<Request> writes = MakeRequests(rng, options.writes);
+  std::vector<BYTE> dest(options.reads * 8);
+  std::vector<BYTE> src(options.writes * 8);
+  for (size_t i = 0; i < src.size(); i++) {
+    src[i] = (BYTE)rng();
+  }
+
+  size_t bytesRead = 0, bytesWritten = 0;
+  for (const Request& r : reads) {
+    bytesRead += r.size;
+  }
+  for (const Request& w : writes) {
+    bytesWritten += w.size;
+  }
+
+  Registry registry;
+  ReadPlan plan;
+  ChangeTracker tracker;
+  std::vector<Handle> changed;
+  if (options.gap >= 0) {
+    for (size_t i = 0; i < reads.size(); i++) {
+      registry.Add(std::to_string(i), Type::ByteArray, reads[i].offset,
+                   reads[i].size);
+    }
+    plan.Build(registry.Targets(), options.gap);
+  }
+
+  std::vector<WriteRequest> writeRequests;
+  for (size_t i = 0; i < writes.size(); i++) {
+    writeRequests.push_back(
+        WriteRequest{writes[i].offset, writes[i].size, &src[i * 8]});
+  }
+
+  // The same writes as a writeBatch() buffer
+  std::vector<BYTE> batch;
+  for (const WriteRequest& write : writeRequests) {
+    WriteBatchRecord record{write.offset, (uint16_t)Type::ByteArray,
+                            (uint16_t)write.size};
+    const BYTE* header = reinterpret_cast<const BYTE*>(&record);
+    const BYTE* payload = static_cast<const BYTE*>(write.src);
+    batch.insert(batch.end(), header, header + sizeof record);
+    batch.insert(batch.end(), payload, payload + write.size);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  if (options.poll > 0 && options.gap >= 0) {
+    // Measure how far the time between ticks deviates from the interval
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<std::chrono::steady_clock::time_point> ticks;
+    bool failed = false;
+
+    Poller poller;
+    poller.Start(std::chrono::microseconds(options.poll), [&] {
+      auto now = std::chrono::steady_clock::now();
+      Error tickResult;
+      applyDeadline();
+      bool ok = ProcessCycle(&ipc, {&plan}, writeRequests, &tickResult);
+
+      std::lock_guard<std::mutex> guard(mutex);
+      ticks.push_back(now);
+      failed |= !ok;
+      if ((int)ticks.size() >= options.cycles || failed) {
+        done.notify_all();
+      }
+    });
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      done.wait(lock, [&] {
+        return (int)ticks.size() >= options.cycles || failed;
+      });
+    }
+    poller.Stop();
+
+    if (failed) {
+      fprintf(stderr, "process: cycle failed while polling\n");
+      return 1;
+    }
+
+    double maxJitter = 0, totalJitter = 0;
+    for (size_t i = 1; i < ticks.size(); i++) {
+      double jitter = std::abs(
+          std::chrono::duration<double, std::micro>(ticks[i] - ticks[i - 1])
+              .count() -
+          options.poll);
+      maxJitter = std::max(maxJitter, jitter);
+      totalJitter += jitter;
+    }
+    printf("poll jitter:  %.1f us mean, %.1f us max (interval %d us)\n",
+           ticks.size() > 1 ? totalJitter / (ticks.size() - 1) : 0.0,
+           maxJitter, options.poll);
+  }
+
+  WriteQueue queue;
+  WriteInbox inbox;
+
+  // Masked writes set every other bit of the first read offsets
+  static const BYTE bitsMask[8] = {0x55, 0x55, 0x55, 0x55,
+                                   0x55, 0x55, 0x55, 0x55};
+  static const BYTE bitsValue[8] = {0xFF, 0xFF, 0xFF, 0xFF,
+                                    0xFF, 0xFF, 0xFF, 0xFF};
+  size_t maskedCount =
+      std::min<size_t>(std::max(options.bits, 0), reads.size());
+  std::vector<Request> masked(reads.begin(), reads.begin() + maskedCount);
+
+  // A masked write after a plain write of the same bytes, with a write to
+  // one of its bytes queued in between, which must keep its value
+  static const BYTE interleavedZero[2] = {0x00, 0x00};
+  static const BYTE interleavedHigh[1] = {0xFF};
+  static const BYTE interleavedBit[2] = {0x01, 0x00};
+
+  for (int cycle = 0; options.poll <= 0 && cycle < options.cycles; cycle++) {
+    applyDeadline();
+    if (options.gap >= 0) {
+      for (int i = 0; i < options.repeat; i++) {
+        if (options.batch) {
+          size_t count, position;
+          BatchError error;
+          if (!ValidateWriteBatch(batch.data(), batch.size(), &count, &error,
+                                  &position)) {
+            fprintf(stderr, "batch: %s\n", BatchErrorToString(error));
+            return 1;
+          }
+          inbox.Push(batch);
+          continue;
+        }
+
+        for (const WriteRequest& write : writeRequests) {
+          queue.Push(write.offset, write.size, write.src);
+        }
+      }
+      inbox.Drain(&queue);
+      if (options.bits > 0) {
+        queue.Push(0x0D0C, 2, interleavedZero);
+        queue.Push(0x0D0D, 1, interleavedHigh);
+        queue.PushMasked(0x0D0C, 2, interleavedBit, interleavedBit);
+      }
+      for (const Request& r : masked) {
+        queue.PushMasked(r.offset, r.size, bitsMask, bitsValue);
+      }
+      if (!queue.Resolve(&ipc, &result)) {
+        fprintf(stderr, "bits: %s\n", ErrorToString(result));
+        return 1;
+      }
+      if (!ProcessCycle(&ipc, {&plan}, queue.Compile(), &result)) {
+        fprintf(stderr, "process: %s\n", ErrorToString(result));
+        return 1;
+      }
+      if (options.changes) {
+        changed.clear();
+        tracker.Update(registry, &changed);
+      }
+      queue.Clear();
+      continue;
+    }
+
+    for (size_t i = 0; i < reads.size(); i++) {
+      if (!ipc.Read(reads[i].offset, reads[i].size, &dest[i * 8], &result)) {
+        fprintf(stderr, "read: %s\n", ErrorToString(result));
+        return 1;
+      }
+    }
+    for (size_t i = 0; i < writes.size(); i++) {
+      if (!ipc.Write(writes[i].offset, writes[i].size, &src[i * 8],
+                     &result)) {
+        fprintf(stderr, "write: %s\n", ErrorToString(result));
+        return 1;
+      }
+    }
+    if (!ipc.Process(&result)) {
+      fprintf(stderr, "process: %s\n", ErrorToString(result));
+      return 1;
+    }
+  }
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  double seconds = std::chrono::duration<double>(elapsed).count();
+
+  // Every cycle writes the same values, so the table is stable after the
+  // first cycle and every destination must match it
+  for (size_t i = 0; options.cycles > 1 && i < reads.size(); i++) {
+    const BYTE* data = options.gap >= 0
+                           ? registry.Data(registry.Offsets()[i])
+                           : &dest[i * 8];
+    if (memcmp(data, &table[reads[i].offset], reads[i].size) != 0) {
+      fprintf(stderr, "verify: read %zu of 0x%04X does not match\n", i,
+              reads[i].offset);
+      return 1;
+    }
+  }
+
+  if (options.bits > 0 && options.gap >= 0 &&
+      (table[0x0D0C] != 0x01 || table[0x0D0D] != 0xFF)) {
+    fprintf(stderr, "verify: write between masked writes was overwritten\n");
+    return 1;
+  }
+
+  for (const Request& r : masked) {
+    for (DWORD i = 0; i < r.size; i++) {
+      if ((table[r.offset + i] & bitsMask[i]) != bitsMask[i]) {
+        fprintf(stderr, "verify: masked write of 0x%04X did not land\n",
+                r.offset);
+        return 1;
+      }
+    }
+  }
+
+  printf("reads/cycle:  %d (%zu bytes)\n", options.reads, bytesRead);
+  if (options.gap >= 0) {
+    printf("read blocks:  %zu in %zu frames (gap %d)\n", plan.Blocks().size(),
+           plan.Frames(), options.gap);
+  }
+  if (options.changes) {
+    printf("changed:      %zu in last cycle\n", changed.size());
+  }
+  printf("writes/cycle: %d (%zu bytes)\n", options.writes, bytesWritten);
+  printf("cycles:       %d in %.3f s\n", options.cycles, seconds);
+  printf("cycle time:   %.2f us\n", seconds * 1e6 / options.cycles);
+  printf("cycles/s:     %.0f\n", options.cycles / seconds);
+
+  Histogram::Summary send = stats.send.Summarize();
+  printf("send:         %.2f us p50, %.2f us p99, %.2f us max (%llu)\n",
+         send.p50 / 1000.0, send.p99 / 1000.0, send.max / 1000.0,
+         (unsigned long long)send.count);
+
+  if (options.trace) {
+    FILE* file = fopen("fsuipc-trace.json", "w");
+    if (!file) {
+      fprintf(stderr, "trace: cannot open fsuipc-trace.json\n");
+      return 1;
+    }
+    fputs(tracer.ToJSON().c_str(), file);
+    fclose(file);
+    printf("trace:        fsuipc-trace.json\n");
+  }
+
+  ipc.Close();
+  return 0;
+}
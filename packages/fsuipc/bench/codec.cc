@@ -0,0 +1,104 @@
+// Microbenchmark for the codec table used by the addon: decodes a slab of
+// offsets of every type into JS values, and encodes those values back, through
+// the same Codec entry points as process() and write(). Built as a Node addon
+// when node-addon-api is found, and run with bench/codec.js.
+#include <napi.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "Codec.h"
+
+using namespace FSUIPC;
+
+namespace {
+
+struct Offset {
+  const Codec* codec;
+  size_t slot;
+  DWORD size;
+};
+
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// run(offsets, cycles) returns the time a cycle takes in microseconds
+Napi::Value Run(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  int count = info[0].ToNumber().Int32Value();
+  int cycles = info[1].ToNumber().Int32Value();
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> typeDist(0, (int)Type::BitArray);
+
+  // Sized types get 16 bytes, except bit arrays that get 2 like the lights
+  // at 0x0D0C
+  std::vector<Offset> offsets;
+  size_t slab = 0;
+  for (int i = 0; i < count; i++) {
+    Type type = (Type)typeDist(rng);
+    const Codec* codec = CodecFor(type);
+    DWORD size = codec->size;
+    if (size == 0) {
+      size = type == Type::BitArray ? 2 : 16;
+    }
+    offsets.push_back(Offset{codec, slab, size});
+    slab += size;
+  }
+
+  std::vector<BYTE> data(slab);
+  for (BYTE& b : data) {
+    b = (BYTE)rng();
+  }
+  // Strings are terminated within their size, so they can be written back
+  for (const Offset& offset : offsets) {
+    data[offset.slot + offset.size - 1] = 0;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (int cycle = 0; cycle < cycles; cycle++) {
+    Napi::HandleScope scope(env);
+    for (const Offset& offset : offsets) {
+      offset.codec->decode(env, &data[offset.slot], offset.size);
+    }
+  }
+  double decodeTime = Since(start);
+
+  std::vector<Napi::Value> values;
+  for (const Offset& offset : offsets) {
+    values.push_back(
+        offset.codec->decode(env, &data[offset.slot], offset.size));
+  }
+
+  // Bit arrays have no encoder, they are skipped
+  std::vector<BYTE> out(slab);
+  start = std::chrono::steady_clock::now();
+  for (int cycle = 0; cycle < cycles; cycle++) {
+    for (int i = 0; i < count; i++) {
+      const Offset& offset = offsets[i];
+      if (offset.codec->encode) {
+        offset.codec->encode(env, values[i], &out[offset.slot], offset.size,
+                             "bench");
+      }
+    }
+  }
+  double encodeTime = Since(start);
+
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("decode", Napi::Number::New(env, decodeTime / cycles));
+  result.Set("encode", Napi::Number::New(env, encodeTime / cycles));
+  return result;
+}
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+  exports.Set("run", Napi::Function::New(env, Run));
+  return exports;
+}
+
+}  // namespace
+
+NODE_API_MODULE(fsuipc_codec_bench, Init)
@@ -0,0 +1,14 @@
+// Runs the codec microbenchmark, see codec.cc:
+//
+//   node bench/codec.js build-bench/fsuipc_codec_bench.node [offsets] [cycles]
+const path = require('path');
+
+const addon = require(path.resolve(process.argv[2]));
+const count = parseInt(process.argv[3] || '1000', 10);
+const cycles = parseInt(process.argv[4] || '10000', 10);
+
+const result = addon.run(count, cycles);
+
+console.log(`offsets: ${count}`);
+console.log(`decode:  ${result.decode.toFixed(2)} us/cycle`);
+console.log(`encode:  ${result.encode.toFixed(2)} us/cycle`);
@@ -9,9 +9,31 @@
             },
             "sources": [
                 "src/index.cc",
+                "src/Bits.cc",
+                "src/ChangeTracker.cc",
+                "src/Codec.cc",
+                "src/Cycle.cc",
                 "src/FSUIPC.cc",
-                "src/IPCUser.cc"
+                "src/Filter.cc",
+                "src/IOThread.cc",
+                "src/IPCUser.cc",
+                "src/Poller.cc",
+                "src/ReadPlan.cc",
+                "src/Registry.cc",
+                "src/RetryPolicy.cc",
+                "src/Scheduler.cc",
+                "src/Stats.cc",
+                "src/Trace.cc",
+                "src/WindowsTransport.cc",
+                "src/WriteBatch.cc",
+                "src/WriteInbox.cc",
+                "src/WriteQueue.cc"
             ],
+            "link_settings": {
+                "libraries": [
+                    "-lwinmm",
+                ],
+            },
             "include_dirs" : [
                 "src",
                 "<!(node -p \"require('node-addon-api').include_dir\")"
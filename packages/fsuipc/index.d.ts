@@ -17,13 +17,140 @@ export const enum Type {
 }
 
 interface Offset {
+  // Identifies the offset until it is removed, handles of removed offsets are reused
+  handle: number;
   name: string;
   offset: number;
   type: Type;
   length: number;
+  group: string;
   test: Type.Byte;
 }
 
+interface LayoutOffset {
+  handle: number;
+  name: string;
+  offset: number;
+  type: Type;
+  size: number;
+  // Position of the offset's value in the buffers of processRaw() and processInto()
+  byteOffset: number;
+}
+
+interface Changes {
+  // Number of processChanges() calls, or ticks of the subscription, so far
+  cycle: number;
+  // Handles of the offsets whose value changed since they were last reported
+  handles: number[];
+  // The new value of each changed offset
+  values: unknown[];
+}
+
+interface Layout {
+  // Changes with every add() or remove()
+  generation: number;
+  // Size of the buffers of processRaw() and processInto()
+  byteLength: number;
+  offsets: LayoutOffset[];
+}
+
+interface AddOptions {
+  // Group the offset is read with, see setGroup(). Defaults to "", which is read every cycle.
+  group?: string;
+  // Filters applied by processChanges() and subscribe({ changes: true }). A changed value is only
+  // reported once it moved by more than deadband, or by more than relativeDeadband times the value
+  // that was last reported. When both are set, passing either one is enough. Only for number types.
+  deadband?: number;
+  relativeDeadband?: number;
+  // Changes are held back until this many milliseconds passed since the value was last reported
+  minIntervalMs?: number;
+  // The value is reported again after this many milliseconds, even if it didn't change
+  maxIntervalMs?: number;
+}
+
+interface GroupOptions {
+  // Minimum time between reads of the group's offsets in milliseconds, 0 reads them every cycle
+  intervalMs: number;
+}
+
+// Durations in microseconds
+interface Histogram {
+  count: number;
+  mean: number;
+  p50: number;
+  p90: number;
+  p99: number;
+  max: number;
+}
+
+interface Stats {
+  cycles: number;
+  // Calls that shared the cycle of an earlier call instead of doing a round trip of their own
+  coalesced: number;
+  // IPC round trips, a cycle takes more than one if its requests don't fit in one
+  transactions: number;
+  // Times a message to the sim had to be resent
+  retries: number;
+  bytesRead: number;
+  bytesWritten: number;
+  errors: number;
+  sizeErrors: number;
+  timeoutErrors: number;
+  // Cycles given up because their deadline passed
+  deadlineErrors: number;
+  // Times the link was restored after it was lost, see FSUIPCOptions.reconnect
+  reconnects: number;
+
+  // From process() until the IO thread picks it up
+  queue: Histogram;
+  // Waiting for other calls to finish
+  lock: Histogram;
+  // All transactions of a cycle
+  cycle: Histogram;
+  // A single transaction, including retries
+  send: Histogram;
+  // Building the result on the main thread
+  convert: Histogram;
+  // From process() until its promise is settled
+  total: Histogram;
+}
+
+interface TraceOptions {
+  // Number of spans kept, older spans are overwritten (default 65536)
+  capacity?: number;
+}
+
+interface CycleOptions {
+  // Reject with ErrorCode.DEADLINE if the sim hasn't answered within this many milliseconds.
+  // Calls that share a cycle wait for the latest deadline of them.
+  deadlineMs?: number;
+  // Reject with ErrorCode.CANCELLED when aborted. The round trip is given up once all calls
+  // sharing the cycle have been aborted.
+  signal?: AbortSignal;
+}
+
+interface ProcessIntoOptions extends CycleOptions {
+  // Generation of the layout the buffer was laid out with
+  generation?: number;
+}
+
+interface ProcessOptions extends CycleOptions {
+  // Resolve with an object whose values are only decoded when first accessed. The values are
+  // getters on its prototype, so Object.keys(), Object.entries() and spread only see the values
+  // that have been accessed. Use toJSON() for a plain object with all values.
+  lazy?: boolean;
+}
+
+interface SubscribeOptions {
+  // Time between cycles in milliseconds
+  intervalMs: number;
+  // Deliver objects whose values are only decoded when first accessed, see ProcessOptions.lazy
+  lazy?: boolean;
+  // Deliver only the offsets that changed and pass their filters, like processChanges(). Ticks
+  // without changes aren't delivered.
+  changes?: boolean;
+}
+
 export enum Simulator {
   ANY,
   FS98,
@@ -41,21 +168,66 @@ export enum Simulator {
   MSFS,
 }
 
+export enum ConnectionState {
+  CLOSED,
+  CONNECTED,
+  // The link was lost and is being restored
+  RECONNECTING,
+}
+
+interface ReconnectOptions {
+  // Time between checks whether the sim is back in milliseconds, defaults to 100
+  probeMs?: number;
+}
+
 type FixedSizedNumberType = Type.Byte|Type.SByte|Type.Int16|Type.Int32|Type.UInt16|Type.UInt32|Type.Double|Type.Single;
 type Int64Type = Type.Int64|Type.UInt64;
 type VariableSizedType = Type.ByteArray|Type.String|Type.BitArray;
 
+export interface FSUIPCOptions {
+  // Reads separated by at most this many bytes are merged into one request, defaults to 16
+  coalesceGap?: number;
+  // Time the sim has to answer a single attempt in milliseconds, defaults to 2000
+  timeoutMs?: number;
+  // Times an attempt is retried, defaults to 8
+  retries?: number;
+  // Wait before the first retry in milliseconds, doubled for every next one up to 16 times
+  // this, defaults to 100
+  backoffMs?: number;
+  // Time open() and a cycle may take in total in milliseconds, 0 for no limit, defaults to 10000
+  deadlineMs?: number;
+  // Restore the link when the sim goes away, keeping offsets and queued writes. Defaults to false.
+  reconnect?: boolean | ReconnectOptions;
+}
+
 export class FSUIPC {
-  constructor();
+  constructor(options?: FSUIPCOptions);
 
   open(requestedSimulator?: Simulator): Promise<FSUIPC>;
   close(): Promise<FSUIPC>;
-  process(): Promise<object>;
+  process(options?: ProcessOptions): Promise<object>;
+  // Resolves with the raw values of all offsets, laid out as described by the layout() of the
+  // buffer's generation
+  processRaw(options?: CycleOptions): Promise<ArrayBuffer & { generation: number }>;
+  // Copies the raw values of all offsets into the buffer, laid out as described by layout().
+  // Rejects if offsets were added or removed since the layout of options.generation, or since the
+  // call if it isn't given.
+  processInto<T extends ArrayBuffer | ArrayBufferView>(buffer: T, options?: ProcessIntoOptions): Promise<T>;
+  // Resolves with only the offsets that changed since the previous call, all offsets are
+  // reported on the first call and after add() or remove(). Changes are filtered as set by
+  // add().
+  processChanges(options?: CycleOptions): Promise<Changes>;
+  // Changes only after add() or remove()
+  layout(): Layout;
+
+  add(name: string, offset: number, type: FixedSizedNumberType | Int64Type, options?: AddOptions): Offset;
+  add(name: string, offset: number, type: VariableSizedType, length: number, options?: AddOptions): Offset;
 
-  add(name: string, offset: number, type: FixedSizedNumberType | Int64Type): Offset;
-  add(name: string, offset: number, type: VariableSizedType, length: number): Offset;
+  remove(nameOrHandle: string | number): Offset;
 
-  remove(name: string): Offset;
+  // Groups are only read by the first cycle after their interval has passed, offsets that
+  // were not read keep their previous value
+  setGroup(group: string, options: GroupOptions): void;
 
   write(offset: number, type: FixedSizedNumberType | Int64Type, value: number): void;
   write(offset: number, type: Int64Type, value: string): void;
@@ -65,6 +237,46 @@ export class FSUIPC {
   write(offset: number, type: Type.String, length: number, value: string): void;
   // Experimental
   write(offset: number, type: Type.ByteArray, length: number, value: ArrayBufferView): void;
+
+  // Sends the write, and any writes queued before it, in a write-only round trip ahead of the
+  // cycles that are waiting. Resolves once the sim has received it.
+  writeNow(offset: number, type: FixedSizedNumberType | Int64Type, value: number): Promise<void>;
+  writeNow(offset: number, type: Int64Type, value: string): Promise<void>;
+  writeNow(offset: number, type: Int64Type, value: bigint): Promise<void>;
+  writeNow(offset: number, type: Type.String, length: number, value: string): Promise<void>;
+  writeNow(offset: number, type: Type.ByteArray, length: number, value: ArrayBufferView): Promise<void>;
+
+  // Queues a write of only the bits set in mask, the other bits keep their value in the sim.
+  // mask and value are little-endian numbers or bigints of at most 8 bytes, or size bytes.
+  writeBits(offset: number, size: number, mask: number | bigint | ArrayBuffer | ArrayBufferView,
+            value: number | bigint | ArrayBuffer | ArrayBufferView): void;
+
+  // Queues all records of a packed buffer, each a little-endian uint32 offset, uint16 type and
+  // uint16 size followed by size bytes of payload. Returns the number of records queued.
+  writeBatch(buffer: ArrayBuffer | ArrayBufferView): number;
+
+  // Processes on a native thread at a fixed interval, until unsubscribe() or close() is called.
+  // If the callback falls behind, only the latest result is delivered.
+  subscribe(options: SubscribeOptions & { changes: true },
+            callback: (err: FSUIPCError | null, result?: Changes) => void): FSUIPC;
+  subscribe(options: SubscribeOptions, callback: (err: FSUIPCError | null, result?: object) => void): FSUIPC;
+  // Resolves once the subscription's thread has stopped. The callback isn't called anymore after
+  // this is called.
+  unsubscribe(): Promise<void>;
+
+  stats(): Stats;
+  resetStats(): void;
+
+  // Records the phases of every open and cycle, dumpTrace() returns them in the Chrome trace
+  // event format
+  startTrace(options?: TraceOptions): void;
+  stopTrace(): void;
+  dumpTrace(): string;
+
+  // Called whenever the connection state changes, with the error that caused the link to be
+  // lost when the state is RECONNECTING. Replaces the previous callback, null removes it.
+  onStateChange(callback: ((state: ConnectionState, cause: ErrorCode) => void) | null): void;
+  connectionState(): ConnectionState;
 }
 
 export enum ErrorCode {
@@ -100,7 +312,11 @@ export enum ErrorCode {
   // Read or Write request cannot be added, memory for Process is full
   SIZE,
   // User does not have permission to connect to FSUIPC
-  NOPERMISSION
+  NOPERMISSION,
+  // Call was aborted through its AbortSignal
+  CANCELLED,
+  // Sim did not answer before the deadline
+  DEADLINE
 }
 
 export class FSUIPCError extends Error {
@@ -0,0 +1,35 @@
+#include "Bits.h"
+
+#include <cstdint>
+
+namespace FSUIPC {
+
+namespace {
+
+// The 8 unpacked bytes of every byte value, so unpacking is one lookup and
+// one 8-byte store per byte instead of a shift and mask per bit
+struct BitTable {
+  uint64_t bytes[256];
+
+  BitTable() {
+    for (int value = 0; value < 256; value++) {
+      BYTE unpacked[8];
+      for (int bit = 0; bit < 8; bit++) {
+        unpacked[bit] = (value >> bit) & 1;
+      }
+      CopyMemory(&this->bytes[value], unpacked, sizeof unpacked);
+    }
+  }
+};
+
+const BitTable table;
+
+}  // namespace
+
+void UnpackBits(const BYTE* src, size_t size, BYTE* dest) {
+  for (size_t i = 0; i < size; i++) {
+    CopyMemory(dest + i * 8, &table.bytes[src[i]], 8);
+  }
+}
+
+}  // namespace FSUIPC
@@ -0,0 +1,16 @@
+#ifndef BITS_H
+#define BITS_H
+
+#include <cstddef>
+
+#include "Platform.h"
+
+namespace FSUIPC {
+
+// Expands each bit of src, least significant first, into a byte of 0 or 1
+// in dest, which must have room for size * 8 bytes
+void UnpackBits(const BYTE* src, size_t size, BYTE* dest);
+
+}  // namespace FSUIPC
+
+#endif
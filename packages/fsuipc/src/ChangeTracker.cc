@@ -0,0 +1,96 @@
+#include "ChangeTracker.h"
+
+#include <cstring>
+
+namespace FSUIPC {
+
+// Slots are 8 byte aligned and zero padded, so they can be compared a word at
+// a time. The loop has no early exit, which lets the compiler vectorize it for
+// large strings and byte arrays.
+static bool SlotChanged(const BYTE* a, const BYTE* b, size_t size) {
+  uint64_t diff = 0;
+  for (size_t i = 0; i < size; i += 8) {
+    uint64_t x, y;
+    std::memcpy(&x, a + i, 8);
+    std::memcpy(&y, b + i, 8);
+    diff |= x ^ y;
+  }
+  return diff != 0;
+}
+
+void ChangeTracker::Update(const Registry& registry,
+                           std::vector<Handle>* changed) {
+  this->Update(registry, std::vector<Filter>(), Filter::Clock::time_point(),
+               changed);
+}
+
+void ChangeTracker::Update(const Registry& registry,
+                           const std::vector<Filter>& filters,
+                           Filter::Clock::time_point now,
+                           std::vector<Handle>* changed) {
+  const std::vector<BYTE>& slab = registry.Slab();
+  const std::vector<Offset>& offsets = registry.Offsets();
+
+  this->cycle++;
+
+  if (this->previous.size() != slab.size() ||
+      this->generation != registry.Generation() || this->cycle == 1) {
+    this->heartbeat = false;
+    for (const Offset& offset : offsets) {
+      changed->push_back(offset.handle);
+      if (offset.handle < filters.size() &&
+          filters[offset.handle].maxInterval.count() > 0) {
+        this->heartbeat = true;
+      }
+    }
+
+    this->previous = slab;
+    this->reported.assign(offsets.size(), now);
+    this->generation = registry.Generation();
+    return;
+  }
+
+  if (!this->heartbeat &&
+      std::memcmp(this->previous.data(), slab.data(), slab.size()) == 0) {
+    return;
+  }
+
+  static const Filter none;
+
+  for (size_t i = 0; i < offsets.size(); i++) {
+    const Offset& offset = offsets[i];
+    const Filter& filter =
+        offset.handle < filters.size() ? filters[offset.handle] : none;
+    size_t end = i + 1 < offsets.size() ? offsets[i + 1].slot : slab.size();
+    size_t slot = offset.slot;
+    auto elapsed = now - this->reported[i];
+
+    bool report =
+        SlotChanged(&this->previous[slot], &slab[slot], end - slot) &&
+        (filter.Empty() || filter.Passes(offset.type, &slab[slot],
+                                         &this->previous[slot], elapsed));
+
+    if (!report && filter.maxInterval.count() > 0 &&
+        elapsed >= filter.maxInterval) {
+      report = true;
+    }
+
+    // Changes that were held back are compared with the bytes that were
+    // reported, not the ones of the previous call
+    if (report) {
+      changed->push_back(offset.handle);
+      std::memcpy(&this->previous[slot], &slab[slot], end - slot);
+      this->reported[i] = now;
+    }
+  }
+}
+
+void ChangeTracker::Reset() {
+  this->previous.clear();
+  this->reported.clear();
+  this->heartbeat = false;
+  this->generation = 0;
+  this->cycle = 0;
+}
+
+}  // namespace FSUIPC
@@ -0,0 +1,44 @@
+#ifndef CHANGETRACKER_H
+#define CHANGETRACKER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Filter.h"
+#include "Registry.h"
+
+namespace FSUIPC {
+
+// Finds the offsets whose bytes differ from the last time they were reported,
+// by comparing the registry's slab with a copy of the reported bytes.
+class ChangeTracker {
+ public:
+  // Appends the handles of the changed offsets. Every offset is reported as
+  // changed on the first call and after offsets were added or removed.
+  void Update(const Registry& registry, std::vector<Handle>* changed);
+  // Like Update(), but only reports the changes that pass the filter of
+  // their handle. Offsets with a maxInterval are also reported when it
+  // passed without a change.
+  void Update(const Registry& registry,
+              const std::vector<Filter>& filters,
+              Filter::Clock::time_point now,
+              std::vector<Handle>* changed);
+  void Reset();
+
+  // Number of calls to Update() since the last Reset()
+  uint64_t Cycle() const { return this->cycle; }
+
+ protected:
+  std::vector<BYTE> previous;
+  // Time each offset was last reported, in registry order
+  std::vector<Filter::Clock::time_point> reported;
+  // Whether any offset has a maxInterval, which has to be checked even if
+  // nothing changed
+  bool heartbeat = false;
+  uint64_t generation = 0;
+  uint64_t cycle = 0;
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,188 @@
+#include "Codec.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "Bits.h"
+
+namespace FSUIPC {
+
+namespace {
+
+template <Type T>
+Napi::Value DecodeNumber(Napi::Env env, const BYTE* data, DWORD size) {
+  return Napi::Number::New(env, (double)Load<T>(data));
+}
+
+template <Type T>
+Napi::Value DecodeBigInt(Napi::Env env, const BYTE* data, DWORD size) {
+  return Napi::BigInt::New(env, Load<T>(data));
+}
+
+Napi::Value DecodeString(Napi::Env env, const BYTE* data, DWORD size) {
+  const char* str = (const char*)data;
+  return Napi::String::New(env, str, strnlen(str, size));
+}
+
+Napi::Value DecodeByteArray(Napi::Env env, const BYTE* data, DWORD size) {
+  Napi::Uint8Array arr = Napi::Uint8Array::New(env, size);
+  CopyMemory(arr.Data(), data, size);
+  return arr;
+}
+
+// One byte of 0 or 1 per bit, least significant bit of the first byte first
+Napi::Value DecodeBitArray(Napi::Env env, const BYTE* data, DWORD size) {
+  Napi::Uint8Array arr = Napi::Uint8Array::New(env, (size_t)size * 8);
+  UnpackBits(data, size, arr.Data());
+  return arr;
+}
+
+template <Type T>
+void EncodeNumber(Napi::Env env,
+                  const Napi::Value& value,
+                  BYTE* data,
+                  DWORD size,
+                  const std::string& method) {
+  typedef typename TypeTraits<T>::Native Native;
+
+  // Other values are coerced like Number(value) does
+  Napi::Number number = value.ToNumber();
+
+  // Integers wrap around like the casts the values used to go through
+  if (std::is_floating_point<Native>::value) {
+    Store<T>(data, (Native)number.DoubleValue());
+  } else {
+    Store<T>(data, (Native)number.Int64Value());
+  }
+}
+
+template <Type T>
+void EncodeBigInt(Napi::Env env,
+                  const Napi::Value& value,
+                  BYTE* data,
+                  DWORD size,
+                  const std::string& method) {
+  typedef typename TypeTraits<T>::Native Native;
+
+  Native x;
+
+  if (value.IsBigInt()) {
+    bool lossless = false;
+    if (std::is_signed<Native>::value) {
+      x = (Native)value.As<Napi::BigInt>().Int64Value(&lossless);
+    } else {
+      x = (Native)value.As<Napi::BigInt>().Uint64Value(&lossless);
+    }
+  } else if (value.IsNumber()) {
+    x = (Native)value.As<Napi::Number>().Int64Value();
+  } else if (value.IsString()) {
+    std::string str = value.As<Napi::String>().Utf8Value();
+    try {
+      if (std::is_signed<Native>::value) {
+        x = (Native)std::stoll(str);
+      } else {
+        x = (Native)std::stoull(str);
+      }
+    } catch (const std::logic_error&) {
+      throw Napi::TypeError::New(
+          env, method + ": expected string to be a 64-bit integer");
+    }
+  } else {
+    throw Napi::TypeError::New(env, method +
+                                        ": expected value to be a string, "
+                                        "int, or bigint when type is 64-bit");
+  }
+
+  Store<T>(data, x);
+}
+
+void EncodeString(Napi::Env env,
+                  const Napi::Value& value,
+                  BYTE* data,
+                  DWORD size,
+                  const std::string& method) {
+  if (!value.IsString()) {
+    throw Napi::TypeError::New(env,
+                               method + ": expected value to be string");
+  }
+
+  std::string str = value.As<Napi::String>().Utf8Value();
+  if (str.length() >= size) {
+    throw Napi::TypeError::New(env, method +
+                                        ": expected string's length to be "
+                                        "less than the supplied size");
+  }
+
+  ZeroMemory(data, size);
+  CopyMemory(data, str.c_str(), str.length());
+}
+
+void EncodeByteArray(Napi::Env env,
+                     const Napi::Value& value,
+                     BYTE* data,
+                     DWORD size,
+                     const std::string& method) {
+  const BYTE* src;
+  size_t length;
+
+  if (value.IsArrayBuffer()) {
+    Napi::ArrayBuffer buffer = value.As<Napi::ArrayBuffer>();
+    src = static_cast<const BYTE*>(buffer.Data());
+    length = buffer.ByteLength();
+  } else if (value.IsTypedArray()) {
+    Napi::TypedArray array = value.As<Napi::TypedArray>();
+    src = static_cast<const BYTE*>(array.ArrayBuffer().Data()) +
+          array.ByteOffset();
+    length = array.ByteLength();
+  } else {
+    throw Napi::TypeError::New(env, method +
+                                        ": expected to receive "
+                                        "ArrayBufferView for byte array type");
+  }
+
+  // Bytes the buffer doesn't have are written as 0
+  ZeroMemory(data, size);
+  CopyMemory(data, src, length < size ? length : size);
+}
+
+template <Type T>
+constexpr Codec NumberCodec() {
+  return Codec{sizeof(typename TypeTraits<T>::Native), DecodeNumber<T>,
+               EncodeNumber<T>};
+}
+
+template <Type T>
+constexpr Codec BigIntCodec() {
+  return Codec{sizeof(typename TypeTraits<T>::Native), DecodeBigInt<T>,
+               EncodeBigInt<T>};
+}
+
+// Indexed by Type
+const Codec codecs[] = {
+    NumberCodec<Type::Byte>(),
+    NumberCodec<Type::SByte>(),
+    NumberCodec<Type::Int16>(),
+    NumberCodec<Type::Int32>(),
+    BigIntCodec<Type::Int64>(),
+    NumberCodec<Type::UInt16>(),
+    NumberCodec<Type::UInt32>(),
+    BigIntCodec<Type::UInt64>(),
+    NumberCodec<Type::Double>(),
+    NumberCodec<Type::Single>(),
+    Codec{0, DecodeByteArray, EncodeByteArray},
+    Codec{0, DecodeString, EncodeString},
+    Codec{0, DecodeBitArray, nullptr},
+};
+
+}  // namespace
+
+const Codec* CodecFor(Type type) {
+  if ((unsigned)type > (unsigned)Type::BitArray) {
+    return nullptr;
+  }
+  return &codecs[(unsigned)type];
+}
+
+}  // namespace FSUIPC
@@ -0,0 +1,38 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+// Disable winsock.h
+#include <napi.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+#include <string>
+
+#include "Platform.h"
+#include "Type.h"
+
+namespace FSUIPC {
+
+// Conversion between the bytes of an offset and its JS value. There is one
+// codec per Type, instantiated from templates, so converting a value is a
+// single indirect call instead of a switch over the type.
+struct Codec {
+  // Size of the fixed-size types, or 0 for the types that take a size
+  DWORD size;
+  Napi::Value (*decode)(Napi::Env env, const BYTE* data, DWORD size);
+  // Throws a TypeError prefixed with method if the value can't be written as
+  // this type, null if the type can't be written
+  void (*encode)(Napi::Env env,
+                 const Napi::Value& value,
+                 BYTE* data,
+                 DWORD size,
+                 const std::string& method);
+};
+
+// Null for unknown types
+const Codec* CodecFor(Type type);
+
+}  // namespace FSUIPC
+
+#endif
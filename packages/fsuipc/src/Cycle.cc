@@ -0,0 +1,182 @@
+#include "Cycle.h"
+
+#include <algorithm>
+
+#include "Protocol.h"
+
+namespace FSUIPC {
+
+// A compiled frame of one of the cycle's read plans
+struct Segment {
+  ReadPlan* plan;
+  size_t frame;
+  DWORD position;  // Where the frame was loaded into the view
+};
+
+static const size_t NONE = (size_t)-1;
+
+bool ProcessCycle(IPCUser* ipc,
+                  const std::vector<ReadPlan*>& plans,
+                  const std::vector<WriteRequest>& writes,
+                  Error* result) {
+  std::vector<Segment> segments;
+  for (ReadPlan* plan : plans) {
+    for (size_t frame = 0; frame < plan->Frames(); frame++) {
+      segments.push_back(Segment{plan, frame, 0});
+    }
+  }
+
+  // Nothing to send, let IPCUser report NODATA
+  if (segments.empty() && writes.empty()) {
+    return ipc->Process(result);
+  }
+
+  // Frames of different plans share transactions when they fit together,
+  // packed first-fit decreasing like the blocks within a plan
+  std::stable_sort(segments.begin(), segments.end(),
+                   [](const Segment& a, const Segment& b) {
+                     return a.plan->FrameSize(a.frame) >
+                            b.plan->FrameSize(b.frame);
+                   });
+
+  std::vector<std::vector<Segment>> transactions;
+  std::vector<size_t> used;
+  for (const Segment& segment : segments) {
+    size_t size = segment.plan->FrameSize(segment.frame);
+    size_t transaction = 0;
+    while (transaction < used.size() && used[transaction] + size > MAX_SIZE) {
+      transaction++;
+    }
+    if (transaction == used.size()) {
+      used.push_back(0);
+      transactions.push_back(std::vector<Segment>());
+    }
+    used[transaction] += size;
+    transactions[transaction].push_back(segment);
+  }
+
+  size_t count = transactions.size();
+  size_t write = 0;
+  unsigned views = ipc->Views();
+
+  // Loads the transaction's reads into the selected view, followed by as
+  // many of the remaining writes as fit once the reads are all loaded
+  auto encode = [&](size_t transaction) {
+    TraceSpan span(ipc->GetTracer(), "encode");
+    bool hasReads = transaction < count;
+
+    if (hasReads) {
+      for (Segment& segment : transactions[transaction]) {
+        segment.position = ipc->Used();
+        if (!segment.plan->Read(ipc, segment.frame, result)) {
+          ipc->Discard();
+          return false;
+        }
+      }
+    }
+
+    if (transaction + 1 >= count) {
+      size_t first = write;
+
+      for (; write < writes.size(); write++) {
+        const WriteRequest& request = writes[write];
+        if (ipc->Write(request.offset, request.size, request.src, result)) {
+          continue;
+        }
+
+        // Continue in the next transaction, unless this write cannot fit in
+        // an empty one either
+        if (*result == Error::SIZE && (hasReads || write > first)) {
+          break;
+        }
+
+        ipc->Discard();
+        return false;
+      }
+    }
+
+    return true;
+  };
+
+  auto receive = [&](size_t transaction) {
+    if (transaction >= count) {
+      return;
+    }
+
+    TraceSpan span(ipc->GetTracer(), "receive");
+    const BYTE* view = ipc->View(transaction % views);
+    for (const Segment& segment : transactions[transaction]) {
+      segment.plan->Receive(view, segment.frame, segment.position);
+    }
+  };
+
+  ipc->Select(0);
+  if (!encode(0)) {
+    return false;
+  }
+
+  // Transaction whose replies are still waiting in its view
+  size_t unreceived = NONE;
+
+  for (size_t transaction = 0;; transaction++) {
+    bool last = transaction + 1 >= count && write >= writes.size();
+
+    if (last || views < 2) {
+      if (!ipc->Process(result)) {
+        return false;
+      }
+      if (unreceived != NONE) {
+        receive(unreceived);
+        unreceived = NONE;
+      }
+      receive(transaction);
+
+      if (last) {
+        break;
+      }
+
+      ipc->Select((transaction + 1) % views);
+      if (!encode(transaction + 1)) {
+        return false;
+      }
+      continue;
+    }
+
+    // While the sim processes this transaction, copy out the replies of the
+    // previous one and encode the next one into the view that frees up
+    ipc->ProcessAsync();
+
+    if (unreceived != NONE) {
+      receive(unreceived);
+    }
+
+    ipc->Select((transaction + 1) % views);
+    bool encoded = encode(transaction + 1);
+
+    Error sent;
+    if (!ipc->Wait(&sent)) {
+      if (encoded) {
+        ipc->Discard();
+      }
+      *result = sent;
+      return false;
+    }
+    if (!encoded) {
+      return false;
+    }
+
+    unreceived = transaction;
+  }
+
+  {
+    TraceSpan span(ipc->GetTracer(), "scatter");
+    for (ReadPlan* plan : plans) {
+      plan->Scatter();
+    }
+  }
+
+  *result = Error::OK;
+  return true;
+}
+
+}  // namespace FSUIPC
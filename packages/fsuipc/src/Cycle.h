@@ -0,0 +1,33 @@
+#ifndef CYCLE_H
+#define CYCLE_H
+
+#include <vector>
+
+#include "IPCUser.h"
+#include "ReadPlan.h"
+
+namespace FSUIPC {
+
+struct WriteRequest {
+  DWORD offset;
+  DWORD size;
+  void* src;
+};
+
+// Sends every frame of the read plans followed by the writes, using as many
+// back-to-back transactions as needed to stay within the IPC buffer. Frames
+// of different plans are combined into the same transaction when they fit.
+// Writes are appended to the last transaction and overflow into write-only
+// ones, so all reads see the state from before this cycle's writes.
+//
+// When the transport has more than one view, the next transaction is encoded
+// and the replies of the previous one are copied out while the sim processes
+// the current one.
+bool ProcessCycle(IPCUser* ipc,
+                  const std::vector<ReadPlan*>& plans,
+                  const std::vector<WriteRequest>& writes,
+                  Error* result);
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef ERROR_H
+#define ERROR_H
+
+namespace FSUIPC {
+
+enum class Error : int {
+  OK = 0,
+  OPEN = 1,
+  NOFS = 2,
+  REGMSG = 3,
+  ATOM = 4,
+  MAP = 5,
+  VIEW = 6,
+  VERSION = 7,
+  WRONGFS = 8,
+  NOTOPEN = 9,
+  NODATA = 10,
+  TIMEOUT = 11,
+  SENDMSG = 12,
+  DATA = 13,
+  RUNNING = 14,
+  SIZE = 15,
+  NOPERMISSION = 16,  // Operation not permitted DWORD error code 0x5
+  CANCELLED = 17,
+  DEADLINE = 18
+};
+
+inline const char* ErrorToString(const Error error) {
+  switch (error) {
+    case Error::OK:
+      return "Okay";
+    case Error::OPEN:
+      return "Attempt to Open when already open";
+    case Error::NOFS:
+      return "Cannot link to FSUIPC or WideClient";
+    case Error::REGMSG:
+      return "Failed to register common message with Windows";
+    case Error::ATOM:
+      return "Failed to create Atom for mapping filename";
+    case Error::MAP:
+      return "Failed to create a file mapping object";
+    case Error::VIEW:
+      return "Failed to open a view to the file map";
+    case Error::VERSION:
+      return "Incorrect version of FSUIPC, or not FSUIPC";
+    case Error::WRONGFS:
+      return "Sim is not version requested";
+    case Error::NOTOPEN:
+      return "Call cannot execute, link not open";
+    case Error::NODATA:
+      return "Call cannot execute: no requests accumulated";
+    case Error::TIMEOUT:
+      return "IPC timed out all retries";
+    case Error::SENDMSG:
+      return "IPC SendMessage failed all retries";
+    case Error::DATA:
+      return "IPC request contains bad data";
+    case Error::RUNNING:
+      return "Maybe running on WideClient, but FS not running on server, or "
+             "wrong FSUIPC";
+    case Error::SIZE:
+      return "Read or Write request cannot be added, memory for process is "
+             "full";
+    case Error::NOPERMISSION:  // Operation not permitted
+      return "Connection denied by the connecting party: please run this "
+             "application as admin";
+    case Error::CANCELLED:
+      return "IPC request was cancelled";
+    case Error::DEADLINE:
+      return "IPC deadline passed before the sim answered";
+  }
+
+  return "";
+}
+
+}  // namespace FSUIPC
+
+#endif
@@ -3,7 +3,10 @@
 
 #include <windows.h>
 
+#include <algorithm>
+#include <cmath>
 #include <string>
+#include <thread>
 
 #include "IPCUser.h"
 
@@ -11,6 +14,33 @@ namespace FSUIPC {
 
 Napi::ObjectReference FSUIPCError;
 
+static Napi::Value NewFSUIPCError(Napi::Env env, Error error) {
+  napi_value args[2] = {Napi::String::New(env, ErrorToString(error)),
+                        Napi::Number::New(env, static_cast<int>(error))};
+  return FSUIPCError.Value().As<Napi::Function>().New(2, args);
+}
+
+// Reads options[name] as a number of milliseconds, returns false if unset
+static bool GetMilliseconds(Napi::Env env,
+                            Napi::Object options,
+                            const char* name,
+                            const std::string& prefix,
+                            std::chrono::milliseconds* value) {
+  Napi::Value number = options.Get(name);
+  if (number.IsUndefined()) {
+    return false;
+  }
+
+  if (!number.IsNumber() || number.ToNumber().DoubleValue() < 0) {
+    throw Napi::TypeError::New(
+        env, prefix + "expected " + name + " to be a number >= 0");
+  }
+
+  *value = std::chrono::milliseconds(
+      (int64_t)number.ToNumber().DoubleValue());
+  return true;
+}
+
 void FSUIPC::Init(Napi::Env env, Napi::Object exports) {
   Napi::Function ctor =
       DefineClass(env, "FSUIPC",
@@ -19,11 +49,33 @@ void FSUIPC::Init(Napi::Env env, Napi::Object exports) {
                       InstanceMethod<&FSUIPC::Close>("close"),
 
                       InstanceMethod<&FSUIPC::Process>("process"),
+                      InstanceMethod<&FSUIPC::ProcessRaw>("processRaw"),
+                      InstanceMethod<&FSUIPC::ProcessInto>("processInto"),
+                      InstanceMethod<&FSUIPC::ProcessChanges>(
+                          "processChanges"),
+                      InstanceMethod<&FSUIPC::Layout>("layout"),
 
                       InstanceMethod<&FSUIPC::Add>("add"),
                       InstanceMethod<&FSUIPC::Remove>("remove"),
+                      InstanceMethod<&FSUIPC::SetGroup>("setGroup"),
 
                       InstanceMethod<&FSUIPC::Write>("write"),
+                      InstanceMethod<&FSUIPC::WriteNow>("writeNow"),
+                      InstanceMethod<&FSUIPC::WriteBits>("writeBits"),
+                      InstanceMethod<&FSUIPC::WriteBatch>("writeBatch"),
+
+                      InstanceMethod<&FSUIPC::Subscribe>("subscribe"),
+                      InstanceMethod<&FSUIPC::Unsubscribe>("unsubscribe"),
+
+                      InstanceMethod<&FSUIPC::GetStats>("stats"),
+                      InstanceMethod<&FSUIPC::ResetStats>("resetStats"),
+                      InstanceMethod<&FSUIPC::StartTrace>("startTrace"),
+                      InstanceMethod<&FSUIPC::StopTrace>("stopTrace"),
+                      InstanceMethod<&FSUIPC::DumpTrace>("dumpTrace"),
+
+                      InstanceMethod<&FSUIPC::OnStateChange>("onStateChange"),
+                      InstanceMethod<&FSUIPC::GetConnectionState>(
+                          "connectionState"),
                   });
 
   Napi::FunctionReference* constructor = new Napi::FunctionReference();
@@ -42,11 +94,85 @@ FSUIPC::FSUIPC(const Napi::CallbackInfo& info)
                            "FSUIPC.new - called without new keyword");
   }
 
-  if (info.Length() != 0) {
-    throw Napi::Error::New(info.Env(), "FSUIPC.new - expected no arguments");
+  if (info.Length() > 1) {
+    throw Napi::Error::New(info.Env(),
+                           "FSUIPC.new - expected at most one argument");
+  }
+
+  if (info.Length() == 1) {
+    if (!info[0].IsObject()) {
+      throw Napi::TypeError::New(
+          info.Env(), "FSUIPC.new - expected first argument to be object");
+    }
+
+    Napi::Object options = info[0].As<Napi::Object>();
+
+    if (options.Has("coalesceGap")) {
+      if (!options.Get("coalesceGap").IsNumber()) {
+        throw Napi::TypeError::New(
+            info.Env(), "FSUIPC.new - expected coalesceGap to be uint");
+      }
+
+      this->coalesce_gap = options.Get("coalesceGap").ToNumber().Uint32Value();
+    }
+
+    std::chrono::milliseconds value;
+    RetryPolicy& policy = this->retry_policy;
+
+    if (GetMilliseconds(info.Env(), options, "timeoutMs", "FSUIPC.new - ",
+                        &value)) {
+      policy.attemptTimeout = std::max(value, std::chrono::milliseconds(1));
+    }
+
+    if (options.Has("retries")) {
+      if (!options.Get("retries").IsNumber()) {
+        throw Napi::TypeError::New(
+            info.Env(), "FSUIPC.new - expected retries to be uint");
+      }
+
+      policy.attempts = options.Get("retries").ToNumber().Uint32Value() + 1;
+    }
+
+    if (GetMilliseconds(info.Env(), options, "backoffMs", "FSUIPC.new - ",
+                        &value)) {
+      policy.backoff = value;
+      policy.maxBackoff = value * 16;
+    }
+
+    GetMilliseconds(info.Env(), options, "deadlineMs", "FSUIPC.new - ",
+                    &this->default_deadline);
+
+    Napi::Value reconnect = options.Get("reconnect");
+    if (reconnect.IsObject()) {
+      this->reconnect = true;
+      GetMilliseconds(info.Env(), reconnect.As<Napi::Object>(), "probeMs",
+                      "FSUIPC.new - ", &this->probe_interval);
+      this->probe_interval =
+          std::max(this->probe_interval, std::chrono::milliseconds(1));
+    } else if (!reconnect.IsUndefined()) {
+      if (!reconnect.IsBoolean()) {
+        throw Napi::TypeError::New(
+            info.Env(),
+            "FSUIPC.new - expected reconnect to be boolean or object");
+      }
+
+      this->reconnect = reconnect.As<Napi::Boolean>().Value();
+    }
   }
 
+  // Completions of the IO thread's jobs are delivered through this, which
+  // only keeps the event loop alive while any are outstanding
+  this->io_done = Napi::ThreadSafeFunction::New(
+      info.Env(),
+      Napi::Function::New(info.Env(), [](const Napi::CallbackInfo&) {}),
+      "FSUIPC.io", 0, 1);
+  this->io_done.Unref(info.Env());
+
   this->ipc = new IPCUser();
+  this->ipc->SetStats(&this->stats);
+  this->ipc->SetTracer(&this->tracer);
+
+  this->Publish();
 }
 
 Napi::Value FSUIPC::Open(const Napi::CallbackInfo& info) {
@@ -63,408 +189,1674 @@ Napi::Value FSUIPC::Open(const Napi::CallbackInfo& info) {
   auto worker = new OpenAsyncWorker(env, deferred, this, requestedSim);
   worker->Queue();
 
-  return deferred.Promise();
+  return deferred.Promise();
+}
+
+Napi::Value FSUIPC::Close(const Napi::CallbackInfo& info) {
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+
+  // The threads are joined by the worker, so Node isn't blocked while they
+  // give up on a hung sim
+  this->supervisor_stopping = true;
+  auto env = info.Env();
+  auto worker = new CloseAsyncWorker(env, deferred, this,
+                                     std::move(this->supervisor),
+                                     this->StopSubscription());
+  worker->Queue();
+
+  return deferred.Promise();
+}
+
+// Reads the options of process() and its variants from info[index]
+static ProcessOptions GetProcessOptions(const Napi::CallbackInfo& info,
+                                        size_t index,
+                                        ProcessMode mode,
+                                        const std::string& method) {
+  Napi::Env env = info.Env();
+  ProcessOptions options;
+  options.mode = mode;
+
+  if (info.Length() <= index || info[index].IsUndefined()) {
+    return options;
+  }
+
+  if (!info[index].IsObject()) {
+    throw Napi::TypeError::New(
+        env, method + ": expected options argument to be object");
+  }
+
+  Napi::Object obj = info[index].As<Napi::Object>();
+
+  std::chrono::milliseconds deadlineMs;
+  if (GetMilliseconds(env, obj, "deadlineMs", method + ": ", &deadlineMs)) {
+    options.deadline = RetryPolicy::Clock::now() + deadlineMs;
+  }
+
+  Napi::Value signal = obj.Get("signal");
+  if (!signal.IsUndefined()) {
+    if (!signal.IsObject() ||
+        !signal.As<Napi::Object>().Get("addEventListener").IsFunction()) {
+      throw Napi::TypeError::New(
+          env, method + ": expected signal to be an AbortSignal");
+    }
+
+    options.signal = signal.As<Napi::Object>();
+  }
+
+  return options;
+}
+
+Napi::Value FSUIPC::Process(const Napi::CallbackInfo& info) {
+  ProcessOptions options =
+      GetProcessOptions(info, 0, ProcessMode::Object, "FSUIPC.Process");
+
+  if (info.Length() > 0 && info[0].IsObject() &&
+      info[0].As<Napi::Object>().Get("lazy").ToBoolean()) {
+    options.mode = ProcessMode::Lazy;
+  }
+
+  return this->QueueProcess(info.Env(), options);
+}
+
+Napi::Value FSUIPC::QueueProcess(Napi::Env env,
+                                 const ProcessOptions& options,
+                                 Napi::Object target) {
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+
+  // The cycle runs with the offsets as they are now
+  if (this->publish_pending) {
+    this->Publish();
+  }
+
+  // Don't start a cycle for a call that was aborted before it was made
+  if (!options.signal.IsEmpty() &&
+      options.signal.Get("aborted").ToBoolean()) {
+    deferred.Reject(NewFSUIPCError(env, Error::CANCELLED));
+    return deferred.Promise();
+  }
+
+  Napi::Function listener;
+  {
+    std::lock_guard<std::mutex> guard(this->pending_mutex);
+
+    // Join the cycle that is queued but hasn't started yet. A cycle that has
+    // started may already have sent its writes, and one whose calls were all
+    // aborted is about to give up, so those aren't joined.
+    if (this->pending_worker && !this->pending_worker->Cancelled()) {
+      this->stats.coalesced++;
+    } else {
+      this->pending_worker = new ProcessAsyncWorker(env, this);
+      this->pending_worker->Queue();
+    }
+
+    listener = this->pending_worker->Join(env, deferred, options, target);
+  }
+
+  // Added once pending_mutex is released, as the signal may run JS that
+  // calls process() again. The cycle can't settle the call meanwhile, that
+  // happens on this thread.
+  if (!listener.IsEmpty()) {
+    options.signal.Get("addEventListener")
+        .As<Napi::Function>()
+        .Call(options.signal, {Napi::String::New(env, "abort"), listener});
+  }
+
+  return deferred.Promise();
+}
+
+Napi::Value FSUIPC::ProcessRaw(const Napi::CallbackInfo& info) {
+  return this->QueueProcess(
+      info.Env(),
+      GetProcessOptions(info, 0, ProcessMode::Raw, "FSUIPC.ProcessRaw"));
+}
+
+Napi::Value FSUIPC::ProcessInto(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.ProcessInto: requires at least one argument");
+  }
+
+  if (!info[0].IsArrayBuffer() && !info[0].IsTypedArray()) {
+    throw Napi::TypeError::New(env,
+                               "FSUIPC.ProcessInto: expected first argument "
+                               "to be ArrayBuffer or TypedArray");
+  }
+
+  ProcessOptions options =
+      GetProcessOptions(info, 1, ProcessMode::Into, "FSUIPC.ProcessInto");
+
+  // The buffer is laid out as layout() describes the offsets now, unless
+  // the caller says which layout it was made for
+  options.generation = this->registry.Generation();
+  if (info.Length() > 1 && info[1].IsObject()) {
+    Napi::Value generation = info[1].As<Napi::Object>().Get("generation");
+    if (!generation.IsUndefined()) {
+      if (!generation.IsNumber()) {
+        throw Napi::TypeError::New(
+            env, "FSUIPC.ProcessInto: expected generation to be a number");
+      }
+      options.generation = (uint64_t)generation.ToNumber().DoubleValue();
+    }
+  }
+
+  return this->QueueProcess(env, options, info[0].As<Napi::Object>());
+}
+
+Napi::Value FSUIPC::ProcessChanges(const Napi::CallbackInfo& info) {
+  return this->QueueProcess(
+      info.Env(), GetProcessOptions(info, 0, ProcessMode::Changes,
+                                    "FSUIPC.ProcessChanges"));
+}
+
+Napi::Value FSUIPC::Layout(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  const std::vector<Offset>& offsets = this->registry.Offsets();
+
+  Napi::Array arr = Napi::Array::New(env, offsets.size());
+  for (size_t i = 0; i < offsets.size(); i++) {
+    Napi::Object obj = Napi::Object::New(env);
+
+    obj.Set("handle", Napi::Number::New(env, offsets[i].handle));
+    obj.Set("name", Napi::String::New(env, offsets[i].name));
+    obj.Set("offset", Napi::Number::New(env, (int)offsets[i].offset));
+    obj.Set("type", Napi::Number::New(env, (int)offsets[i].type));
+    obj.Set("size", Napi::Number::New(env, (int)offsets[i].size));
+    obj.Set("byteOffset", Napi::Number::New(env, (double)offsets[i].slot));
+
+    arr.Set(i, obj);
+  }
+
+  Napi::Object layout = Napi::Object::New(env);
+
+  layout.Set("generation",
+             Napi::Number::New(env, (double)this->registry.Generation()));
+  layout.Set("byteLength",
+             Napi::Number::New(env, (double)this->registry.Slab().size()));
+  layout.Set("offsets", arr);
+
+  return layout;
+}
+
+// Reads an optional number >= 0 of the options of add()
+static bool GetFilterOption(Napi::Object options,
+                            const char* name,
+                            double* value) {
+  if (!options.Has(name)) {
+    return true;
+  }
+
+  Napi::Value option = options.Get(name);
+  if (!option.IsNumber()) {
+    return false;
+  }
+
+  *value = option.ToNumber().DoubleValue();
+  return *value >= 0 && std::isfinite(*value);
+}
+
+Napi::Value FSUIPC::Add(const Napi::CallbackInfo& info) {
+  FSUIPC* self = this;
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 3) {
+    throw Napi::Error::New(env, "FSUIPC.Add: requires at least 3 arguments");
+  }
+
+  if (!info[0].IsString()) {
+    throw Napi::Error::New(env,
+                           "FSUIPC.Add: expected first argument to be string");
+  }
+
+  if (!info[1].IsNumber()) {
+    throw Napi::Error::New(env,
+                           "FSUIPC.Add: expected second argument to be int");
+  }
+
+  if (!info[2].IsNumber()) {
+    throw Napi::Error::New(env,
+                           "FSUIPC.Add: expected third argument to be int");
+  }
+
+  std::string name =
+      std::string(info[0].As<Napi::String>().Utf8Value().c_str());
+  DWORD offset = info[1].ToNumber().Uint32Value();
+  Type type = (Type)info[2].ToNumber().Int32Value();
+
+  const Codec* codec = CodecFor(type);
+  if (!codec) {
+    throw Napi::TypeError::New(env, "FSUIPC.Add: unknown type");
+  }
+
+  DWORD size = codec->size;
+  size_t optionsIndex = 3;
+
+  if (size == 0) {
+    optionsIndex = 4;
+
+    if (info.Length() < 4) {
+      throw Napi::TypeError::New(
+          env,
+          "FSUIPC.Add: requires at least 4 arguments if type is "
+          "byteArray, bitArray or string");
+    }
+
+    if (!info[3].IsNumber()) {
+      throw Napi::TypeError::New(
+          env, "FSUIPC.Add: expected fourth argument to be uint");
+    }
+
+    size = (int)info[3].ToNumber().Uint32Value();
+  }
+
+  if (size == 0) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.Add: expected fourth argument to be a size > 0");
+  }
+
+  if ((uint64_t)offset + size > 0x100000000ull) {
+    throw Napi::RangeError::New(
+        env, "FSUIPC.Add: offset and size are past the last offset");
+  }
+
+  std::string group;
+  Filter filter;
+
+  if (info.Length() > optionsIndex) {
+    if (!info[optionsIndex].IsObject()) {
+      throw Napi::TypeError::New(
+          env, "FSUIPC.Add: expected options argument to be object");
+    }
+
+    Napi::Object options = info[optionsIndex].As<Napi::Object>();
+
+    if (options.Has("group")) {
+      if (!options.Get("group").IsString()) {
+        throw Napi::TypeError::New(env,
+                                   "FSUIPC.Add: expected group to be string");
+      }
+
+      group = options.Get("group").As<Napi::String>().Utf8Value();
+    }
+
+    double deadband = 0;
+    double relative = 0;
+    double minInterval = 0;
+    double maxInterval = 0;
+
+    if (!GetFilterOption(options, "deadband", &deadband) ||
+        !GetFilterOption(options, "relativeDeadband", &relative) ||
+        !GetFilterOption(options, "minIntervalMs", &minInterval) ||
+        !GetFilterOption(options, "maxIntervalMs", &maxInterval)) {
+      throw Napi::TypeError::New(
+          env,
+          "FSUIPC.Add: expected deadband, relativeDeadband, minIntervalMs "
+          "and maxIntervalMs to be numbers >= 0");
+    }
+
+    if ((deadband > 0 || relative > 0) && !IsNumeric(type)) {
+      throw Napi::TypeError::New(
+          env, "FSUIPC.Add: deadbands are only supported for number types");
+    }
+
+    filter.deadband = deadband;
+    filter.relative = relative;
+    filter.minInterval = std::chrono::microseconds(
+        (std::chrono::microseconds::rep)(minInterval * 1000));
+    filter.maxInterval = std::chrono::microseconds(
+        (std::chrono::microseconds::rep)(maxInterval * 1000));
+  }
+
+  Handle handle = self->registry.Add(name, type, offset, size, group);
+  if (handle >= self->codecs.size()) {
+    self->codecs.resize(handle + 1);
+    self->filters.resize(handle + 1);
+  }
+  self->codecs[handle] = codec;
+  self->filters[handle] = filter;
+  self->SchedulePublish();
+
+  Napi::Object obj = Napi::Object::New(env);
+
+  obj.Set("handle", Napi::Number::New(env, handle));
+  obj.Set("name", Napi::String::New(env, name));
+  obj.Set("offset", info[1]);
+  obj.Set("type", Napi::Number::New(env, (int)type));
+  obj.Set("size", Napi::Number::New(env, (int)size));
+  obj.Set("group", Napi::String::New(env, group));
+
+  return obj;
+}
+
+Napi::Value FSUIPC::Remove(const Napi::CallbackInfo& info) {
+  FSUIPC* self = this;
+  Napi::Env env = info.Env();
+
+  if (info.Length() != 1) {
+    throw Napi::TypeError::New(env, "FSUIPC.Remove: requires one argument");
+  }
+
+  const Offset* found;
+
+  if (info[0].IsString()) {
+    found = self->registry.Find(info[0].As<Napi::String>().Utf8Value());
+  } else if (info[0].IsNumber()) {
+    found = self->registry.Find((Handle)info[0].ToNumber().Uint32Value());
+  } else {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.Remove: expected first argument to be string or handle");
+  }
+
+  if (!found) {
+    throw Napi::Error::New(env, "FSUIPC.Remove: offset is not registered");
+  }
+
+  Offset removed;
+  self->registry.Remove(found->handle, &removed);
+  self->SchedulePublish();
+
+  Napi::Object obj = Napi::Object::New(env);
+
+  obj.Set("handle", Napi::Number::New(env, removed.handle));
+  obj.Set("name", Napi::String::New(env, removed.name));
+  obj.Set("offset", Napi::Number::New(env, (int)removed.offset));
+  obj.Set("type", Napi::Number::New(env, (int)removed.type));
+  obj.Set("size", Napi::Number::New(env, (int)removed.size));
+
+  return obj;
+}
+
+void FSUIPC::SetGroup(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() != 2) {
+    throw Napi::TypeError::New(env, "FSUIPC.SetGroup: requires two arguments");
+  }
+
+  if (!info[0].IsString()) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.SetGroup: expected first argument to be string");
+  }
+
+  if (!info[1].IsObject()) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.SetGroup: expected second argument to be object");
+  }
+
+  Napi::Value intervalMs = info[1].As<Napi::Object>().Get("intervalMs");
+  if (!intervalMs.IsNumber() || intervalMs.ToNumber().DoubleValue() < 0) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.SetGroup: expected intervalMs to be a number >= 0");
+  }
+
+  this->intervals[info[0].As<Napi::String>().Utf8Value()] =
+      std::chrono::microseconds(
+          (int64_t)(intervalMs.ToNumber().DoubleValue() * 1000));
+  this->SchedulePublish();
+}
+
+// Encodes the value of a write() or writeNow() call into a WriteInbox record
+static std::vector<BYTE> EncodeWrite(const Napi::CallbackInfo& info,
+                                     const std::string& method) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 3) {
+    throw Napi::TypeError::New(env, method + ": requires at least 3 arguments");
+  }
+
+  if (!info[0].IsNumber()) {
+    throw Napi::TypeError::New(env,
+                               method + ": expected first argument to be uint");
+  }
+
+  if (!info[1].IsNumber()) {
+    throw Napi::TypeError::New(env,
+                               method + ": expected second argument to be int");
+  }
+
+  DWORD offset = info[0].ToNumber().Uint32Value();
+  Type type = (Type)info[1].ToNumber().Int32Value();
+
+  const Codec* codec = CodecFor(type);
+  if (!codec || !codec->encode) {
+    throw Napi::TypeError::New(env, method + ": unsupported type for write");
+  }
+
+  DWORD size = codec->size;
+  Napi::Value value = info[2];
+
+  if (size == 0) {
+    if (info.Length() < 4) {
+      throw Napi::TypeError::New(env, method +
+                                          ": requires at least 4 arguments if "
+                                          "type is byteArray, bitArray or "
+                                          "string");
+    }
+
+    if (!info[2].IsNumber()) {
+      throw Napi::TypeError::New(
+          env, method + ": expected third argument to be uint");
+    }
+
+    size = (int)info[2].ToNumber().Uint32Value();
+    value = info[3];
+  }
+
+  if (size == 0) {
+    throw Napi::TypeError::New(env, method + ": expected size to be > 0");
+  }
+
+  if (size > MAX_WRITE_SIZE) {
+    throw Napi::RangeError::New(env, method + ": size is too large");
+  }
+
+  std::vector<BYTE> record = WriteInbox::Record(offset, size);
+  codec->encode(env, value, WriteInbox::Payload(record), size, method);
+
+  return record;
+}
+
+void FSUIPC::Write(const Napi::CallbackInfo& info) {
+  this->write_inbox.Push(EncodeWrite(info, "FSUIPC.Write"));
+}
+
+Napi::Value FSUIPC::WriteNow(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  this->write_inbox.Push(EncodeWrite(info, "FSUIPC.WriteNow"));
+
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+  (new WriteNowAsyncWorker(env, deferred, this))->Queue(true);
+
+  return deferred.Promise();
+}
+
+// Copies a mask or value of writeBits() into size bytes, from a number or
+// BigInt of at most 8 bytes little-endian, or from a buffer of size bytes
+static bool GetBits(Napi::Value value, BYTE* dest, DWORD size) {
+  if (value.IsNumber() || value.IsBigInt()) {
+    if (size > 8) {
+      return false;
+    }
+
+    uint64_t bits;
+    if (value.IsNumber()) {
+      double number = value.As<Napi::Number>().DoubleValue();
+      if (number < 0 || number >= 18446744073709551616.0 ||
+          number != (double)(uint64_t)number) {
+        return false;
+      }
+      bits = (uint64_t)number;
+    } else {
+      bool lossless;
+      bits = value.As<Napi::BigInt>().Uint64Value(&lossless);
+      if (!lossless) {
+        return false;
+      }
+    }
+
+    if (size < 8 && (bits >> (8 * size)) != 0) {
+      return false;
+    }
+
+    for (DWORD i = 0; i < size; i++) {
+      dest[i] = (BYTE)(bits >> (8 * i));
+    }
+    return true;
+  }
+
+  const BYTE* data;
+  size_t length;
+
+  if (value.IsArrayBuffer()) {
+    Napi::ArrayBuffer buffer = value.As<Napi::ArrayBuffer>();
+    data = static_cast<const BYTE*>(buffer.Data());
+    length = buffer.ByteLength();
+  } else if (value.IsTypedArray()) {
+    Napi::TypedArray array = value.As<Napi::TypedArray>();
+    data = static_cast<const BYTE*>(array.ArrayBuffer().Data()) +
+           array.ByteOffset();
+    length = array.ByteLength();
+  } else {
+    return false;
+  }
+
+  if (length != size) {
+    return false;
+  }
+
+  CopyMemory(dest, data, size);
+  return true;
+}
+
+void FSUIPC::WriteBits(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() != 4) {
+    throw Napi::TypeError::New(env, "FSUIPC.WriteBits: requires 4 arguments");
+  }
+
+  if (!info[0].IsNumber()) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.WriteBits: expected first argument to be uint");
+  }
+
+  if (!info[1].IsNumber()) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.WriteBits: expected second argument to be uint");
+  }
+
+  DWORD offset = info[0].ToNumber().Uint32Value();
+  DWORD size = info[1].ToNumber().Uint32Value();
+
+  // The bytes are read before they are written, so they have to fit both
+  if (size == 0 || size > MAX_READ_SIZE) {
+    throw Napi::RangeError::New(
+        env, "FSUIPC.WriteBits: expected size to be > 0 and fit a request");
+  }
+
+  std::vector<BYTE> record = WriteInbox::MaskedRecord(offset, size);
+  BYTE* mask = WriteInbox::Payload(record);
+
+  if (!GetBits(info[2], mask, size)) {
+    throw Napi::TypeError::New(
+        env,
+        "FSUIPC.WriteBits: expected mask to be a uint or BigInt of at most 8 "
+        "bytes, or a buffer of size bytes");
+  }
+
+  if (!GetBits(info[3], mask + size, size)) {
+    throw Napi::TypeError::New(
+        env,
+        "FSUIPC.WriteBits: expected value to be a uint or BigInt of at most "
+        "8 bytes, or a buffer of size bytes");
+  }
+
+  this->write_inbox.PushMasked(std::move(record));
+}
+
+Napi::Value FSUIPC::WriteBatch(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() != 1) {
+    throw Napi::TypeError::New(env, "FSUIPC.WriteBatch: requires 1 argument");
+  }
+
+  const BYTE* data;
+  size_t length;
+
+  if (info[0].IsArrayBuffer()) {
+    Napi::ArrayBuffer buffer = info[0].As<Napi::ArrayBuffer>();
+    data = static_cast<const BYTE*>(buffer.Data());
+    length = buffer.ByteLength();
+  } else if (info[0].IsTypedArray()) {
+    Napi::TypedArray array = info[0].As<Napi::TypedArray>();
+    data = static_cast<const BYTE*>(array.ArrayBuffer().Data()) +
+           array.ByteOffset();
+    length = array.ByteLength();
+  } else {
+    throw Napi::TypeError::New(env,
+                               "FSUIPC.WriteBatch: expected first argument to "
+                               "be ArrayBuffer or TypedArray");
+  }
+
+  size_t count;
+  BatchError error;
+  size_t position;
+
+  if (!ValidateWriteBatch(data, length, &count, &error, &position)) {
+    throw Napi::RangeError::New(
+        env, "FSUIPC.WriteBatch: record at byte " + std::to_string(position) +
+                 ": " + BatchErrorToString(error));
+  }
+
+  this->write_inbox.Push(std::vector<BYTE>(data, data + length));
+
+  return Napi::Number::New(env, (double)count);
+}
+
+Napi::Value FSUIPC::Subscribe(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() != 2) {
+    throw Napi::TypeError::New(env,
+                               "FSUIPC.Subscribe: requires two arguments");
+  }
+
+  if (!info[0].IsObject()) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.Subscribe: expected first argument to be object");
+  }
+
+  if (!info[1].IsFunction()) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.Subscribe: expected second argument to be function");
+  }
+
+  Napi::Value intervalMs = info[0].As<Napi::Object>().Get("intervalMs");
+  if (!intervalMs.IsNumber() || intervalMs.ToNumber().DoubleValue() <= 0) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.Subscribe: expected intervalMs to be a number > 0");
+  }
+
+  if (this->subscription) {
+    throw Napi::Error::New(env, "FSUIPC.Subscribe: already subscribed");
+  }
+
+  std::shared_ptr<Subscription> subscription =
+      std::make_shared<Subscription>();
+  subscription->lazy = info[0].As<Napi::Object>().Get("lazy").ToBoolean();
+  subscription->changes =
+      info[0].As<Napi::Object>().Get("changes").ToBoolean();
+
+  if (this->publish_pending) {
+    this->Publish();
+  }
+
+  // Keep this object and the subscription alive until the last frame has
+  // been delivered
+  this->Ref();
+  subscription->callback = Napi::ThreadSafeFunction::New(
+      env, info[1].As<Napi::Function>(), "FSUIPC.subscribe", 0, 1,
+      [this, subscription](Napi::Env) { this->Unref(); });
+
+  subscription->poller.Start(
+      std::chrono::microseconds(
+          (int64_t)(intervalMs.ToNumber().DoubleValue() * 1000)),
+      [this, subscription = subscription.get()] {
+        this->Tick(subscription);
+      });
+  this->subscription = subscription;
+
+  return this->Value();
+}
+
+Napi::Value FSUIPC::Unsubscribe(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+
+  auto worker = new UnsubscribeAsyncWorker(env, deferred, this,
+                                           this->StopSubscription());
+  worker->Queue(true);
+
+  return deferred.Promise();
+}
+
+std::shared_ptr<Subscription> FSUIPC::StopSubscription() {
+  std::shared_ptr<Subscription> subscription = std::move(this->subscription);
+  this->subscription = nullptr;
+
+  // A tick waiting for a hung sim gives up, and no frame is delivered anymore
+  if (subscription) {
+    subscription->stopping = true;
+  }
+  return subscription;
+}
+
+// Takes fsuipc_mutex for a thread that is joined on the main thread, or gives
+// up once stopping is raised, so the join never waits for a cycle of another
+// caller
+static bool LockUnlessStopping(std::unique_lock<std::mutex>* lock,
+                               const std::atomic<bool>& stopping) {
+  // std::mutex can't be waited on with a condition, so a cycle that holds it
+  // is polled for. This only happens while another caller's cycle runs.
+  while (!lock->try_lock()) {
+    if (stopping) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+void FSUIPC::Tick(Subscription* subscription) {
+  TraceSpan span(&this->tracer, "tick");
+  Error result;
+  bool ok;
+
+  {
+    std::unique_lock<std::mutex> fsuipc_guard(this->fsuipc_mutex,
+                                              std::defer_lock);
+    if (!LockUnlessStopping(&fsuipc_guard, subscription->stopping)) {
+      return;
+    }
+
+    // Restore a lost link first, so values resume with this tick
+    if (this->state == ConnectionState::RECONNECTING) {
+      this->Reconnect(&subscription->stopping);
+    }
+
+    RetryPolicy policy = this->DefaultPolicy(RetryPolicy::Clock::now());
+    policy.cancelled = &subscription->stopping;
+    this->ipc->SetRetryPolicy(policy);
+    ok = this->RunCycle(&result);
+    this->ipc->SetRetryPolicy(this->retry_policy);
+
+    // A lost link is reported as a state change instead, and nothing is
+    // delivered once unsubscribed
+    if (!ok && (this->state == ConnectionState::RECONNECTING ||
+                subscription->stopping)) {
+      return;
+    }
+
+    // Values that didn't pass their filter are never copied or converted
+    if (ok && subscription->changes) {
+      subscription->tick_changed.clear();
+      subscription->tracker.Update(this->live, this->live_set->filters,
+                                   std::chrono::steady_clock::now(),
+                                   &subscription->tick_changed);
+      if (subscription->tick_changed.empty()) {
+        return;
+      }
+    }
+
+    std::lock_guard<std::mutex> frame_guard(subscription->frame_mutex);
+    subscription->frame_error = ok ? Error::OK : result;
+    if (ok) {
+      subscription->frame = this->live.Slab();
+      subscription->frame_set = this->live_set;
+    }
+
+    // The changes of frames that were overwritten are delivered with this
+    // one, as the tracker has already counted them as reported
+    if (ok && subscription->changes) {
+      std::vector<Handle>& changed = subscription->frame_changed;
+      bool merge = !changed.empty();
+      changed.insert(changed.end(), subscription->tick_changed.begin(),
+                     subscription->tick_changed.end());
+      if (merge) {
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()),
+                      changed.end());
+      }
+      subscription->frame_cycle = subscription->tracker.Cycle();
+    }
+  }
+
+  // Frames overwrite each other until JS picks up the latest one
+  if (!subscription->frame_pending.exchange(true)) {
+    subscription->callback.NonBlockingCall(
+        [this, subscription](Napi::Env env, Napi::Function callback) {
+          this->Deliver(subscription, env, callback);
+        });
+  }
+}
+
+void FSUIPC::Deliver(Subscription* subscription,
+                     Napi::Env env,
+                     Napi::Function callback) {
+  Napi::HandleScope scope(env);
+  TraceSpan span(&this->tracer, "deliver");
+
+  // Frames read before unsubscribe() are dropped, as it doesn't wait for the
+  // tick to finish
+  if (subscription->stopping) {
+    return;
+  }
+
+  std::vector<BYTE> frame;
+  std::shared_ptr<const OffsetSet> set;
+  std::vector<Handle> changed;
+  uint64_t cycle;
+  Error error;
+
+  {
+    std::lock_guard<std::mutex> frame_guard(subscription->frame_mutex);
+    subscription->frame_pending = false;
+    frame.swap(subscription->frame);
+    set = std::move(subscription->frame_set);
+    changed.swap(subscription->frame_changed);
+    cycle = subscription->frame_cycle;
+    error = subscription->frame_error;
+  }
+
+  if (error != Error::OK) {
+    callback.Call({NewFSUIPCError(env, error)});
+
+    // Changes read before the failed cycle are still delivered, they won't
+    // be reported again
+    if (changed.empty() || !set) {
+      return;
+    }
+  }
+
+  if (subscription->changes) {
+    callback.Call({env.Null(), this->ToChanges(env, *set, frame.data(),
+                                                changed, cycle)});
+    return;
+  }
+
+  // The frame carries the offsets it was read with, so it is delivered as
+  // read even if offsets were added or removed since
+  Napi::Object obj =
+      subscription->lazy ? this->ToLazyObject(env, *set, frame.data())
+                         : this->ToObject(env, *set, frame.data());
+
+  callback.Call({env.Null(), obj});
+}
+
+// Durations are reported in microseconds
+static Napi::Object SummaryToObject(Napi::Env env,
+                                    const Histogram& histogram) {
+  Histogram::Summary summary = histogram.Summarize();
+  Napi::Object obj = Napi::Object::New(env);
+
+  obj.Set("count", Napi::Number::New(env, (double)summary.count));
+  obj.Set("mean", Napi::Number::New(env, summary.mean / 1000));
+  obj.Set("p50", Napi::Number::New(env, summary.p50 / 1000.0));
+  obj.Set("p90", Napi::Number::New(env, summary.p90 / 1000.0));
+  obj.Set("p99", Napi::Number::New(env, summary.p99 / 1000.0));
+  obj.Set("max", Napi::Number::New(env, summary.max / 1000.0));
+
+  return obj;
+}
+
+Napi::Value FSUIPC::GetStats(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  Napi::Object obj = Napi::Object::New(env);
+
+  obj.Set("cycles", Napi::Number::New(env, (double)this->stats.cycles));
+  obj.Set("coalesced", Napi::Number::New(env, (double)this->stats.coalesced));
+  obj.Set("transactions",
+          Napi::Number::New(env, (double)this->stats.transactions));
+  obj.Set("retries", Napi::Number::New(env, (double)this->stats.retries));
+  obj.Set("bytesRead", Napi::Number::New(env, (double)this->stats.bytesRead));
+  obj.Set("reconnects",
+          Napi::Number::New(env, (double)this->stats.reconnects));
+  obj.Set("bytesWritten",
+          Napi::Number::New(env, (double)this->stats.bytesWritten));
+  obj.Set("errors", Napi::Number::New(env, (double)this->stats.errors));
+  obj.Set("sizeErrors",
+          Napi::Number::New(env, (double)this->stats.sizeErrors));
+  obj.Set("timeoutErrors",
+          Napi::Number::New(env, (double)this->stats.timeoutErrors));
+  obj.Set("deadlineErrors",
+          Napi::Number::New(env, (double)this->stats.deadlineErrors));
+
+  obj.Set("queue", SummaryToObject(env, this->stats.queue));
+  obj.Set("lock", SummaryToObject(env, this->stats.lock));
+  obj.Set("cycle", SummaryToObject(env, this->stats.cycle));
+  obj.Set("send", SummaryToObject(env, this->stats.send));
+  obj.Set("convert", SummaryToObject(env, this->stats.convert));
+  obj.Set("total", SummaryToObject(env, this->stats.total));
+
+  return obj;
+}
+
+void FSUIPC::ResetStats(const Napi::CallbackInfo& info) {
+  this->stats.Reset();
+}
+
+void FSUIPC::StartTrace(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  size_t capacity = 65536;
+
+  if (info.Length() > 0 && !info[0].IsUndefined()) {
+    if (!info[0].IsObject()) {
+      throw Napi::TypeError::New(
+          env, "FSUIPC.StartTrace: expected first argument to be object");
+    }
+
+    Napi::Object options = info[0].As<Napi::Object>();
+
+    if (options.Has("capacity")) {
+      if (!options.Get("capacity").IsNumber() ||
+          options.Get("capacity").ToNumber().Int64Value() <= 0) {
+        throw Napi::TypeError::New(
+            env, "FSUIPC.StartTrace: expected capacity to be a number > 0");
+      }
+
+      capacity = (size_t)options.Get("capacity").ToNumber().Int64Value();
+    }
+  }
+
+  this->tracer.Start(capacity);
+}
+
+void FSUIPC::StopTrace(const Napi::CallbackInfo& info) {
+  this->tracer.Stop();
+}
+
+Napi::Value FSUIPC::DumpTrace(const Napi::CallbackInfo& info) {
+  return Napi::String::New(info.Env(), this->tracer.ToJSON());
+}
+
+void FSUIPC::OnStateChange(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() != 1 ||
+      !(info[0].IsFunction() || info[0].IsNull() || info[0].IsUndefined())) {
+    throw Napi::TypeError::New(
+        env, "FSUIPC.OnStateChange: expected argument to be function or null");
+  }
+
+  std::lock_guard<std::mutex> guard(this->state_mutex);
+
+  if (this->state_callback) {
+    this->state_callback.Release();
+    this->state_callback = Napi::ThreadSafeFunction();
+  }
+
+  if (info[0].IsFunction()) {
+    this->state_callback = Napi::ThreadSafeFunction::New(
+        env, info[0].As<Napi::Function>(), "FSUIPC.onStateChange", 0, 1);
+    // Only cycles and the supervisor keep the process running
+    this->state_callback.Unref(env);
+  }
+}
+
+Napi::Value FSUIPC::GetConnectionState(const Napi::CallbackInfo& info) {
+  return Napi::Number::New(info.Env(), static_cast<int>(this->state.load()));
+}
+
+void FSUIPC::SetState(ConnectionState state, Error cause) {
+  if (this->state.exchange(state) == state) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(this->state_mutex);
+
+  if (this->state_callback) {
+    this->state_callback.NonBlockingCall(
+        [state, cause](Napi::Env env, Napi::Function callback) {
+          callback.Call({Napi::Number::New(env, static_cast<int>(state)),
+                         Napi::Number::New(env, static_cast<int>(cause))});
+        });
+  }
+}
+
+bool FSUIPC::LinkLost(Error error) const {
+  switch (error) {
+    case Error::TIMEOUT:
+    case Error::SENDMSG:
+      return true;
+    case Error::DEADLINE:
+      // A sim that is only slow still has its window
+      return !this->ipc->GetTransport()->Available();
+    default:
+      return false;
+  }
+}
+
+bool FSUIPC::Reconnect(const std::atomic<bool>* cancelled) {
+  if (this->state != ConnectionState::RECONNECTING ||
+      !this->ipc->GetTransport()->Available()) {
+    return false;
+  }
+
+  RetryPolicy policy = this->DefaultPolicy(RetryPolicy::Clock::now());
+  policy.cancelled = cancelled ? cancelled : &this->supervisor_stopping;
+
+  Error result;
+  this->ipc->SetRetryPolicy(policy);
+  bool ok = this->ipc->Open(this->requested_sim, &result);
+  this->ipc->SetRetryPolicy(this->retry_policy);
+
+  if (!ok) {
+    return false;
+  }
+
+  // Values of groups with an interval are stale after the link was lost
+  this->expire_groups = true;
+  this->stats.reconnects++;
+  this->SetState(ConnectionState::CONNECTED, Error::OK);
+  return true;
+}
+
+void FSUIPC::Supervise() {
+  if (this->state != ConnectionState::RECONNECTING) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> guard(this->fsuipc_mutex, std::defer_lock);
+  if (LockUnlessStopping(&guard, this->supervisor_stopping)) {
+    this->Reconnect();
+  }
+}
+
+Napi::Object FSUIPC::ToObject(Napi::Env env,
+                              const OffsetSet& set,
+                              const BYTE* slab) {
+  const std::vector<Offset>& offsets = set.registry.Offsets();
+
+  // The result is built with a single call so every result gets the same
+  // shape without growing it one property at a time
+  Napi::Object keys = this->ResultKeys(env, set.registry);
+
+  this->result_properties.clear();
+  for (uint32_t i = 0; i < offsets.size(); i++) {
+    const Offset& offset = offsets[i];
+
+    this->result_properties.push_back(Napi::PropertyDescriptor::Value(
+        keys.Get(i),
+        set.codecs[offset.handle]->decode(env, &slab[offset.slot],
+                                          offset.size),
+        napi_default_jsproperty));
+  }
+
+  Napi::Object obj = Napi::Object::New(env);
+  obj.DefineProperties(this->result_properties);
+
+  return obj;
+}
+
+Napi::Object FSUIPC::ResultKeys(Napi::Env env, const Registry& registry) {
+  // Offset names are only turned into strings again when they change
+  if (this->result_keys.IsEmpty() ||
+      this->result_generation != registry.Generation()) {
+    const std::vector<Offset>& offsets = registry.Offsets();
+
+    Napi::Array keys = Napi::Array::New(env, offsets.size());
+    for (uint32_t i = 0; i < offsets.size(); i++) {
+      keys.Set(i, Napi::String::New(env, offsets[i].name));
+    }
+
+    this->result_keys = Napi::Persistent(keys.As<Napi::Object>());
+    this->result_generation = registry.Generation();
+  }
+
+  return this->result_keys.Value();
 }
 
-Napi::Value FSUIPC::Close(const Napi::CallbackInfo& info) {
-  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+// Getter of an offset on the prototype of lazy results, info.Data() is the
+// index of its LazyField
+static Napi::Value LazyGet(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
 
-  auto env = info.Env();
-  auto worker = new CloseAsyncWorker(env, deferred, this);
-  worker->Queue();
+  void* data = nullptr;
+  if (napi_unwrap(env, info.This(), &data) != napi_ok || !data) {
+    // Accessed on the prototype itself
+    return env.Undefined();
+  }
 
-  return deferred.Promise();
-}
+  LazyResult* result = static_cast<LazyResult*>(data);
+  const LazyField& field = (*result->fields)[(size_t)info.Data()];
 
-Napi::Value FSUIPC::Process(const Napi::CallbackInfo& info) {
-  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+  Napi::Value value =
+      field.codec->decode(env, &result->slab[field.slot], field.size);
 
-  auto env = info.Env();
-  auto worker = new ProcessAsyncWorker(env, deferred, this);
-  worker->Queue();
+  // Shadow the getter, so the value is only decoded once
+  info.This().As<Napi::Object>().DefineProperty(Napi::PropertyDescriptor::Value(
+      field.name.c_str(), value, napi_default_jsproperty));
 
-  return deferred.Promise();
+  return value;
 }
 
-Napi::Value FSUIPC::Add(const Napi::CallbackInfo& info) {
-  FSUIPC* self = this;
+// Decodes all values, so JSON.stringify() sees the same object as process()
+// without lazy
+static Napi::Value LazyToJSON(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
+  Napi::Object self = info.This().As<Napi::Object>();
 
-  if (info.Length() < 3) {
-    throw Napi::Error::New(env, "FSUIPC.Add: requires at least 3 arguments");
+  void* data = nullptr;
+  if (napi_unwrap(env, self, &data) != napi_ok || !data) {
+    return env.Undefined();
   }
 
-  if (!info[0].IsString()) {
-    throw Napi::Error::New(env,
-                           "FSUIPC.Add: expected first argument to be string");
-  }
+  LazyResult* result = static_cast<LazyResult*>(data);
+  Napi::Object obj = Napi::Object::New(env);
 
-  if (!info[1].IsNumber()) {
-    throw Napi::Error::New(env,
-                           "FSUIPC.Add: expected second argument to be int");
+  for (const LazyField& field : *result->fields) {
+    obj.Set(field.name, self.Get(field.name));
   }
 
-  if (!info[2].IsNumber()) {
-    throw Napi::Error::New(env,
-                           "FSUIPC.Add: expected third argument to be int");
-  }
+  return obj;
+}
 
-  std::string name =
-      std::string(info[0].As<Napi::String>().Utf8Value().c_str());
-  DWORD offset = info[1].ToNumber().Uint32Value();
-  Type type = (Type)info[2].ToNumber().Int32Value();
+Napi::Object FSUIPC::ToLazyObject(Napi::Env env,
+                                  const OffsetSet& set,
+                                  const BYTE* slab) {
+  const Registry& registry = set.registry;
 
-  DWORD size;
+  if (this->lazy_prototype.IsEmpty() ||
+      this->lazy_generation != registry.Generation()) {
+    const std::vector<Offset>& offsets = registry.Offsets();
+    Napi::Object keys = this->ResultKeys(env, registry);
 
-  if (type == Type::ByteArray || type == Type::BitArray ||
-      type == Type::String) {
-    if (info.Length() < 4) {
-      throw Napi::TypeError::New(
-          env,
-          "FSUIPC.Add: requires at least 4 arguments if type is "
-          "byteArray, bitArray or string");
+    auto fields = std::make_shared<std::vector<LazyField>>();
+    std::vector<Napi::PropertyDescriptor> properties;
+    bool hasToJSON = false;
+
+    for (uint32_t i = 0; i < offsets.size(); i++) {
+      const Offset& offset = offsets[i];
+
+      fields->push_back(LazyField{offset.name, set.codecs[offset.handle],
+                                  offset.slot, offset.size});
+      properties.push_back(Napi::PropertyDescriptor::Accessor<LazyGet>(
+          keys.Get(i).As<Napi::Name>(),
+          (napi_property_attributes)(napi_enumerable | napi_configurable),
+          (void*)(uintptr_t)i));
+
+      hasToJSON |= offset.name == "toJSON";
     }
 
-    if (!info[3].IsNumber()) {
-      throw Napi::TypeError::New(
-          env, "FSUIPC.Add: expected fourth argument to be uint");
+    if (!hasToJSON) {
+      properties.push_back(
+          Napi::PropertyDescriptor::Function<LazyToJSON>("toJSON"));
     }
 
-    size = (int)info[3].ToNumber().Uint32Value();
-  } else {
-    size = get_size_of_type(type);
-  }
+    Napi::Object prototype = Napi::Object::New(env);
+    prototype.DefineProperties(properties);
 
-  if (size == 0) {
-    throw Napi::TypeError::New(
-        env, "FSUIPC.Add: expected fourth argument to be a size > 0");
+    this->lazy_prototype = Napi::Persistent(prototype);
+    this->lazy_fields = fields;
+    this->lazy_generation = registry.Generation();
   }
 
-  self->offsets[name] = Offset{name, type, offset, size, malloc(size)};
-
-  Napi::Object obj = Napi::Object::New(env);
+  if (this->object_create.IsEmpty()) {
+    this->object_create = Napi::Persistent(env.Global()
+                                               .Get("Object")
+                                               .As<Napi::Object>()
+                                               .Get("create")
+                                               .As<Napi::Function>());
+  }
 
-  obj.Set("name", Napi::String::New(env, name));
-  obj.Set("offset", info[1]);
-  obj.Set("type", Napi::Number::New(env, (int)type));
-  obj.Set("size", Napi::Number::New(env, (int)size));
+  Napi::Object obj =
+      this->object_create.Call({this->lazy_prototype.Value()})
+          .As<Napi::Object>();
+
+  LazyResult* result = new LazyResult{
+      this->lazy_fields,
+      std::vector<BYTE>(slab, slab + registry.Slab().size())};
+
+  napi_status status = napi_wrap(
+      env, obj, result,
+      [](napi_env, void* data, void*) {
+        delete static_cast<LazyResult*>(data);
+      },
+      nullptr, nullptr);
+  if (status != napi_ok) {
+    delete result;
+    throw Napi::Error::New(env, "FSUIPC: failed to create lazy result");
+  }
 
   return obj;
 }
 
-Napi::Value FSUIPC::Remove(const Napi::CallbackInfo& info) {
-  FSUIPC* self = this;
-  Napi::Env env = info.Env();
-
-  if (info.Length() != 1) {
-    throw Napi::TypeError::New(env, "FSUIPC.Remove: requires one argument");
-  }
+Napi::Object FSUIPC::ToChanges(Napi::Env env,
+                               const OffsetSet& set,
+                               const BYTE* slab,
+                               const std::vector<Handle>& changed,
+                               uint64_t cycle) {
+  Napi::Array handles = Napi::Array::New(env);
+  Napi::Array values = Napi::Array::New(env);
+  uint32_t count = 0;
+
+  for (Handle handle : changed) {
+    // Changes of a frame that was overwritten can be of removed offsets
+    const Offset* offset = set.registry.Find(handle);
+    if (!offset) {
+      continue;
+    }
 
-  if (!info[0].IsString()) {
-    throw Napi::TypeError::New(
-        env, "FSUIPC.Remove: expected first argument to be string");
+    handles.Set(count, Napi::Number::New(env, handle));
+    values.Set(count, set.codecs[handle]->decode(env, &slab[offset->slot],
+                                                 offset->size));
+    count++;
   }
 
-  std::string name =
-      std::string(info[0].As<Napi::String>().Utf8Value().c_str());
-
-  auto it = self->offsets.find(name);
-
   Napi::Object obj = Napi::Object::New(env);
 
-  obj.Set("name", Napi::String::New(env, it->second.name));
-  obj.Set("offset", Napi::Number::New(env, (int)it->second.offset));
-  obj.Set("type", Napi::Number::New(env, (int)it->second.type));
-  obj.Set("size", Napi::Number::New(env, (int)it->second.size));
-
-  self->offsets.erase(it);
+  obj.Set("cycle", Napi::Number::New(env, (double)cycle));
+  obj.Set("handles", handles);
+  obj.Set("values", values);
 
   return obj;
 }
 
-void FSUIPC::Write(const Napi::CallbackInfo& info) {
-  FSUIPC* self = this;
-  Napi::Env env = info.Env();
-
-  if (info.Length() < 3) {
-    throw Napi::TypeError::New(env,
-                               "FSUIPC.Write: requires at least 3 arguments");
+RetryPolicy FSUIPC::DefaultPolicy(RetryPolicy::Clock::time_point start) const {
+  RetryPolicy policy = this->retry_policy;
+  if (this->default_deadline.count() > 0) {
+    policy.deadline = start + this->default_deadline;
   }
+  return policy;
+}
 
-  if (!info[0].IsNumber()) {
-    throw Napi::TypeError::New(
-        env, "FSUIPC.Write: expected first argument to be uint");
+void FSUIPC::SchedulePublish() {
+  if (this->publish_pending) {
+    return;
   }
-
-  if (!info[1].IsNumber()) {
-    throw Napi::TypeError::New(
-        env, "FSUIPC.Write: expected second argument to be int");
+  this->publish_pending = true;
+
+  // Publish once the current JS task is done, so a burst of add() calls
+  // only copies the offsets once
+  this->Ref();
+  napi_status status =
+      this->io_done.NonBlockingCall([this](Napi::Env, Napi::Function) {
+        if (this->publish_pending) {
+          this->Publish();
+        }
+        this->Unref();
+      });
+
+  // Left to the next process() or subscribe()
+  if (status != napi_ok) {
+    this->Unref();
   }
+}
 
-  DWORD offset = info[0].ToNumber().Uint32Value();
-  Type type = (Type)info[1].ToNumber().Int32Value();
+void FSUIPC::Publish() {
+  this->publish_pending = false;
 
-  DWORD size;
-  void* value;
+  std::shared_ptr<OffsetSet> set = std::make_shared<OffsetSet>();
+  set->registry = this->registry;
+  set->codecs = this->codecs;
+  set->filters = this->filters;
+  set->intervals = this->intervals;
+  this->offset_set.Store(std::move(set));
+}
 
-  if (type == Type::ByteArray || type == Type::BitArray ||
-      type == Type::String) {
-    if (info.Length() < 4) {
-      throw Napi::TypeError::New(env,
-                                 "FSUIPC.Write: requires at least 4 arguments "
-                                 "if type is byteArray, bitArray or string");
+void FSUIPC::Adopt(std::shared_ptr<const OffsetSet> set) {
+  for (const auto& it : set->intervals) {
+    if (!this->live_set || this->live_set->intervals.count(it.first) == 0 ||
+        this->live_set->intervals.at(it.first) != it.second) {
+      this->scheduler.SetInterval(it.first, it.second);
     }
+  }
 
-    if (!info[2].IsNumber()) {
-      throw Napi::TypeError::New(
-          env, "FSUIPC.Write: expected third argument to be uint");
+  if (!this->live_set ||
+      this->live_set->registry.Generation() != set->registry.Generation()) {
+    Registry next = set->registry;
+
+    // Offsets that are still registered keep their value until their group
+    // is read again
+    for (const Offset& offset : next.Offsets()) {
+      const Offset* previous = this->live.Find(offset.handle);
+      if (previous && previous->offset == offset.offset &&
+          previous->size == offset.size) {
+        std::memcpy(next.Data(offset), this->live.Data(*previous), offset.size);
+      }
     }
 
-    size = (int)info[2].ToNumber().Uint32Value();
-  } else {
-    size = get_size_of_type(type);
+    this->live = std::move(next);
+    this->scheduler.Build(this->live, this->coalesce_gap);
   }
 
-  if (size == 0) {
-    throw Napi::TypeError::New(env, "FSUIPC.Add: expected size to be > 0");
+  // The previous version is freed here unless a result still refers to it
+  this->live_set = std::move(set);
+}
+
+// Whether the writes of a cycle that failed with error can succeed in a later
+// one, because the sim was only slow, went away or the call gave up
+static bool WritesRetryable(Error error) {
+  switch (error) {
+    case Error::TIMEOUT:
+    case Error::SENDMSG:
+    case Error::DEADLINE:
+    case Error::CANCELLED:
+    case Error::NOTOPEN:
+      return true;
+    default:
+      return false;
   }
+}
 
-  value = malloc(size);
+bool FSUIPC::RunCycle(Error* result, bool writesOnly) {
+  std::shared_ptr<const OffsetSet> set = this->offset_set.Load();
+  if (set != this->live_set) {
+    this->Adopt(std::move(set));
+  }
 
-  switch (type) {
-    case Type::Byte: {
-      uint8_t x = (uint8_t)info[2].ToNumber().Uint32Value();
+  // Keep the writes queued until the link is restored
+  if (this->state == ConnectionState::RECONNECTING) {
+    *result = Error::NOTOPEN;
+    return false;
+  }
+  if (this->expire_groups.exchange(false)) {
+    this->scheduler.Expire();
+  }
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
+  Scheduler::Clock::time_point now = Scheduler::Clock::now();
 
-      break;
-    }
-    case Type::SByte: {
-      int8_t x = (int8_t)info[2].ToNumber().Int32Value();
+  std::vector<ReadPlan*> plans;
+  if (!writesOnly) {
+    this->scheduler.Select(now, &plans);
+  }
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
+  this->write_inbox.Drain(&this->write_queue);
 
-      break;
+  // No group is due and there is nothing to write, so skip the round trip
+  if (this->write_queue.Empty() &&
+      (writesOnly || (plans.empty() && this->live.Size() > 0))) {
+    *result = Error::OK;
+    return true;
+  }
+
+  bool ok;
+  size_t written = 0;
+  {
+    TraceSpan span(&this->tracer, "cycle");
+
+    // Masked writes read the bytes they change first
+    ok = this->write_queue.Resolve(this->ipc, result);
+    if (ok) {
+      const std::vector<WriteRequest>& writes = this->write_queue.Compile();
+      for (const WriteRequest& write : writes) {
+        written += write.size;
+      }
+      ok = ProcessCycle(this->ipc, plans, writes, result);
+    }
+  }
+  this->stats.cycle.Record(Scheduler::Clock::now() - now);
+  this->stats.cycles++;
+
+  if (!ok) {
+    this->stats.errors++;
+    if (*result == Error::SIZE) {
+      this->stats.sizeErrors++;
+    } else if (*result == Error::TIMEOUT) {
+      this->stats.timeoutErrors++;
+    } else if (*result == Error::DEADLINE) {
+      this->stats.deadlineErrors++;
     }
-    case Type::Int16: {
-      int16_t x = (int16_t)info[2].ToNumber().Int32Value();
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
+    // Writes that may still succeed stay queued, ahead of the ones pushed
+    // during this cycle. Any other error would fail every later cycle too,
+    // so the writes are dropped with this one.
+    if (!WritesRetryable(*result)) {
+      this->write_queue.Clear();
+    }
 
-      break;
+    if (this->reconnect && this->state == ConnectionState::CONNECTED &&
+        this->LinkLost(*result)) {
+      this->ipc->Close();
+      this->SetState(ConnectionState::RECONNECTING, *result);
     }
-    case Type::Int32: {
-      int32_t x = info[2].ToNumber().Int32Value();
+    return false;
+  }
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
+  if (!writesOnly) {
+    this->scheduler.Commit(now);
+  }
 
-      break;
+  for (const ReadPlan* plan : plans) {
+    for (const ReadBlock& block : plan->Blocks()) {
+      this->stats.bytesRead += block.size;
     }
-    case Type::UInt16: {
-      uint16_t x = (uint16_t)info[2].ToNumber().Uint32Value();
+  }
+  this->stats.bytesWritten += written;
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
+  this->write_queue.Clear();
 
-      break;
-    }
-    case Type::UInt32: {
-      uint32_t x = info[2].ToNumber().Uint32Value();
+  return true;
+}
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
+void IOWorker::Queue(bool urgent) {
+  FSUIPC* fsuipc = this->fsuipc;
 
-      break;
-    }
-    case Type::Double: {
-      double x = info[2].ToNumber().DoubleValue();
+  fsuipc->Ref();
+  if (fsuipc->io_outstanding++ == 0) {
+    fsuipc->io_done.Ref(this->env);
+  }
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
+  fsuipc->io_thread.Post(
+      [this, fsuipc] {
+        this->Execute();
+        fsuipc->io_done.BlockingCall(
+            [this](Napi::Env, Napi::Function) { this->Complete(); });
+      },
+      urgent);
+}
 
-      break;
-    }
-    case Type::Single: {
-      float x = (float)info[2].ToNumber().FloatValue();
+void IOWorker::Complete() {
+  FSUIPC* fsuipc = this->fsuipc;
+  Napi::Env env = this->env;
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
+  if (this->error.empty()) {
+    this->OnOK();
+  } else {
+    this->OnError(Napi::Error::New(env, this->error));
+  }
+  delete this;
 
-      break;
-    }
-    case Type::Int64: {
-      int64_t x;
+  if (--fsuipc->io_outstanding == 0) {
+    fsuipc->io_done.Unref(env);
+  }
+  fsuipc->Unref();
+}
 
-      if (info[2].IsString()) {
-        std::string x_str =
-            std::string(info[2].As<Napi::String>().Utf8Value().c_str());
-        x = std::stoll(x_str);
-      } else if (info[2].IsNumber()) {
-        x = info[2].ToNumber().Int64Value();
-      } else if (info[2].IsBigInt()) {
-        bool lossless = false;
-        x = info[2].As<Napi::BigInt>().Int64Value(&lossless);
-      } else {
-        throw Napi::TypeError::New(
-            env,
-            "FSUIPC.Write: expected third argument to "
-            "be a string, int, or bigint when type is int64");
-      }
+bool ProcessAsyncWorker::Abort::Settle() {
+  if (this->settled) {
+    return false;
+  }
+  this->settled = true;
+
+  Napi::Object signal = this->signal.Value();
+  signal.Get("removeEventListener")
+      .As<Napi::Function>()
+      .Call(signal, {Napi::String::New(signal.Env(), "abort"),
+                     this->listener.Value()});
+
+  // The listener holds on to this, so drop it to break the cycle
+  this->signal.Reset();
+  this->listener.Reset();
+  return true;
+}
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
-
-      break;
-    }
-    case Type::UInt64: {
-      uint64_t x;
-
-      if (info[2].IsString()) {
-        std::string x_str =
-            std::string(info[2].As<Napi::String>().Utf8Value().c_str());
-        x = std::stoll(x_str);
-      } else if (info[2].IsNumber()) {
-        x = info[2].ToNumber().Uint32Value();
-      } else if (info[2].IsBigInt()) {
-        bool lossless = false;
-        x = info[2].As<Napi::BigInt>().Uint64Value(&lossless);
-      } else {
-        throw Napi::TypeError::New(
-            env,
-            "FSUIPC.Write: expected third argument to "
-            "be a string, int, or bigint when type is uint64");
-      }
+Napi::Function ProcessAsyncWorker::Join(Napi::Env env,
+                                        Napi::Promise::Deferred deferred,
+                                        const ProcessOptions& options,
+                                        Napi::Object target) {
+  Waiter waiter{deferred, options.mode, Napi::ObjectReference(),
+                std::chrono::steady_clock::now(), nullptr, options.generation};
+  if (options.mode == ProcessMode::Into) {
+    waiter.target = Napi::Persistent(target);
+  }
 
-      std::copy(
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)),
-          static_cast<const uint8_t*>(static_cast<const void*>(&x)) + sizeof x,
-          static_cast<uint8_t*>(value));
+  this->tracked |= options.mode == ProcessMode::Changes;
 
-      break;
-    }
-    case Type::String: {
-      std::memset(value, 0, size);
+  if (options.deadline == RetryPolicy::Clock::time_point::max()) {
+    this->unbounded = true;
+  } else {
+    this->deadline = std::max(this->deadline, options.deadline);
+  }
 
-      std::string x_str =
-          std::string(info[3].As<Napi::String>().Utf8Value().c_str());
-      if (x_str.length() >= size) {
-        throw Napi::TypeError::New(env,
-                                   "FSUIPC.Write: expected string's length to "
-                                   "be less than the supplied size");
-      }
+  this->cancel->live++;
 
-      const char* x_c_str = x_str.c_str();
+  Napi::Function listener;
+  if (!options.signal.IsEmpty()) {
+    std::shared_ptr<Abort> abort = std::make_shared<Abort>(Abort{deferred});
+    std::shared_ptr<CycleCancel> cancel = this->cancel;
 
-      strcpy_s((char*)value, size, x_str.c_str());
+    listener = Napi::Function::New(
+        env,
+        [abort, cancel](const Napi::CallbackInfo& info) {
+          if (!abort->Settle()) {
+            return;
+          }
 
-      break;
-    }
-    case Type::ByteArray: {
-      std::memset(value, 0, size);
+          abort->deferred.Reject(NewFSUIPCError(info.Env(), Error::CANCELLED));
 
-      if (info[3].IsArrayBuffer()) {
-        Napi::ArrayBuffer view = info[3].As<Napi::ArrayBuffer>();
+          // Give up the round trip once no call is waiting for it
+          if (--cancel->live == 0) {
+            cancel->cancelled = true;
+          }
+        },
+        "abort");
 
-        std::memcpy(value, view.Data(), size);
-      } else {
-        throw Napi::TypeError::New(env,
-                                   "FSUIPC.Write: expected to receive "
-                                   "ArrayBufferView for byte array type");
-      }
+    abort->signal = Napi::Persistent(options.signal);
+    abort->listener = Napi::Persistent(listener);
 
-      break;
-    }
-    default: {
-      throw Napi::TypeError::New(env,
-                                 "FSUIPC.Write: unsupported type for write");
-    }
+    waiter.abort = abort;
   }
 
-  self->offset_writes.push_back(OffsetWrite{type, offset, size, value});
+  this->waiters.push_back(std::move(waiter));
+  return listener;
 }
 
 void ProcessAsyncWorker::Execute() {
   Error result;
+  Stats& stats = this->fsuipc->stats;
 
-  std::lock_guard<std::mutex> guard(this->fsuipc->offsets_mutex);
-  std::lock_guard<std::mutex> fsuipc_guard(this->fsuipc->fsuipc_mutex);
+  Tracer& tracer = this->fsuipc->tracer;
+  TraceSpan span(&tracer, "process");
 
-  auto offsets = this->fsuipc->offsets;
+  // From here on, process() calls queue the next cycle
+  {
+    std::lock_guard<std::mutex> guard(this->fsuipc->pending_mutex);
+    if (this->fsuipc->pending_worker == this) {
+      this->fsuipc->pending_worker = nullptr;
+    }
+  }
 
-  std::map<std::string, Offset>::iterator it = offsets.begin();
+  auto start = std::chrono::steady_clock::now();
+  stats.queue.Record(start - this->queued);
 
-  for (; it != offsets.end(); ++it) {
-    if (!this->fsuipc->ipc->Read(it->second.offset, it->second.size,
-                                 it->second.dest, &result)) {
-      this->SetError(ErrorToString(result));
-      this->errorCode = static_cast<int>(result);
-      return;
-    }
+  if (this->Cancelled()) {
+    this->SetError(ErrorToString(Error::CANCELLED));
+    this->errorCode = static_cast<int>(Error::CANCELLED);
+    return;
   }
 
-  auto offset_writes = this->fsuipc->offset_writes;
+  // Bounded by the latest deadline any of the calls asked for
+  RetryPolicy policy = this->fsuipc->DefaultPolicy(start);
+  if (!this->unbounded) {
+    policy.deadline = this->deadline;
+  } else {
+    policy.deadline = std::max(policy.deadline, this->deadline);
+  }
+  policy.cancelled = &this->cancel->cancelled;
 
-  std::vector<OffsetWrite>::iterator write_it = offset_writes.begin();
+  std::lock_guard<std::mutex> fsuipc_guard(this->fsuipc->fsuipc_mutex);
 
-  for (; write_it != offset_writes.end(); ++write_it) {
-    if (!this->fsuipc->ipc->Write(write_it->offset, write_it->size,
-                                  write_it->src, &result)) {
-      this->SetError(ErrorToString(result));
-      this->errorCode = static_cast<int>(result);
-      return;
-    }
+  auto locked = std::chrono::steady_clock::now();
+  stats.lock.Record(locked - start);
 
-    free(write_it->src);
+  if (tracer.Enabled()) {
+    tracer.Record("queue", this->queued, start);
+    tracer.Record("lock", start, locked);
   }
 
-  this->fsuipc->offset_writes.clear();
+  // Restore a lost link first, so this call doesn't wait for the supervisor
+  if (this->fsuipc->state == ConnectionState::RECONNECTING) {
+    this->fsuipc->Reconnect();
+  }
+
+  IPCUser* ipc = this->fsuipc->ipc;
+  ipc->SetRetryPolicy(policy);
+  bool ok = this->fsuipc->RunCycle(&result);
+  ipc->SetRetryPolicy(this->fsuipc->retry_policy);
 
-  if (!this->fsuipc->ipc->Process(&result)) {
+  if (!ok) {
     this->SetError(ErrorToString(result));
     this->errorCode = static_cast<int>(result);
     return;
   }
+
+  this->set = this->fsuipc->live_set;
+  this->snapshot = this->fsuipc->live.Slab();
+  if (this->tracked) {
+    this->fsuipc->change_tracker.Update(
+        this->fsuipc->live, this->set->filters,
+        std::chrono::steady_clock::now(), &this->changed);
+    this->cycle = this->fsuipc->change_tracker.Cycle();
+  }
 }
 
 void ProcessAsyncWorker::OnOK() {
   Napi::Env env = this->Env();
   Napi::HandleScope scope(env);
+  Stats& stats = this->fsuipc->stats;
 
-  std::lock_guard<std::mutex> guard(this->fsuipc->offsets_mutex);
+  auto start = std::chrono::steady_clock::now();
 
-  auto offsets = this->fsuipc->offsets;
+  for (Waiter& waiter : this->waiters) {
+    // Calls rejected by their AbortSignal are already settled
+    if (waiter.abort && !waiter.abort->Settle()) {
+      continue;
+    }
+    this->Resolve(env, waiter);
+  }
 
-  Napi::Object obj = Napi::Object::New(env);
-  std::map<std::string, Offset>::iterator it = offsets.begin();
+  auto end = std::chrono::steady_clock::now();
+  stats.convert.Record(end - start);
+  for (const Waiter& waiter : this->waiters) {
+    stats.total.Record(end - waiter.queued);
+  }
+
+  if (this->fsuipc->tracer.Enabled()) {
+    this->fsuipc->tracer.Record("resolve", start, end);
+  }
+}
+
+void ProcessAsyncWorker::Resolve(Napi::Env env, Waiter& waiter) {
+  if (waiter.mode == ProcessMode::Raw) {
+    Napi::ArrayBuffer buffer =
+        Napi::ArrayBuffer::New(env, this->snapshot.size());
+    if (!this->snapshot.empty()) {
+      std::memcpy(buffer.Data(), this->snapshot.data(), this->snapshot.size());
+    }
+
+    // The cycle can run with other offsets than layout() describes by the
+    // time the result arrives, the generation tells which layout it has
+    uint64_t generation = this->set->registry.Generation();
+    buffer.Set("generation", Napi::Number::New(env, (double)generation));
+    waiter.deferred.Resolve(buffer);
+    return;
+  }
+
+  if (waiter.mode == ProcessMode::Into) {
+    Napi::Object target = waiter.target.Value();
+
+    // Offsets were added or removed since, so the values would land at
+    // other positions than the caller reads them from
+    if (this->set->registry.Generation() != waiter.generation) {
+      waiter.deferred.Reject(
+          Napi::Error::New(env,
+                           "FSUIPC.ProcessInto: offsets were added or "
+                           "removed since the buffer's layout")
+              .Value());
+      return;
+    }
+
+    BYTE* data;
+    size_t length;
+
+    if (target.IsArrayBuffer()) {
+      Napi::ArrayBuffer buffer = target.As<Napi::ArrayBuffer>();
+      data = (BYTE*)buffer.Data();
+      length = buffer.ByteLength();
+    } else {
+      Napi::TypedArray array = target.As<Napi::TypedArray>();
+      data = (BYTE*)array.ArrayBuffer().Data() + array.ByteOffset();
+      length = array.ByteLength();
+    }
+
+    if (length < this->snapshot.size()) {
+      waiter.deferred.Reject(
+          Napi::RangeError::New(env,
+                                "FSUIPC.ProcessInto: buffer is smaller than "
+                                "the layout's byteLength")
+              .Value());
+      return;
+    }
+
+    if (!this->snapshot.empty()) {
+      std::memcpy(data, this->snapshot.data(), this->snapshot.size());
+    }
+
+    waiter.deferred.Resolve(target);
+    return;
+  }
+
+  const OffsetSet& set = *this->set;
+
+  if (waiter.mode == ProcessMode::Changes) {
+    waiter.deferred.Resolve(this->fsuipc->ToChanges(
+        env, set, this->snapshot.data(), this->changed, this->cycle));
+    return;
+  }
 
-  for (; it != offsets.end(); ++it) {
-    (obj).Set(it->second.name, this->GetValue(it->second.type, it->second.dest,
-                                              it->second.size));
+  if (waiter.mode == ProcessMode::Lazy) {
+    waiter.deferred.Resolve(
+        this->fsuipc->ToLazyObject(env, set, this->snapshot.data()));
+    return;
   }
 
-  this->deferred.Resolve(obj);
+  waiter.deferred.Resolve(
+      this->fsuipc->ToObject(env, set, this->snapshot.data()));
 }
 
 void ProcessAsyncWorker::OnError(const Napi::Error& e) {
@@ -475,104 +1867,49 @@ void ProcessAsyncWorker::OnError(const Napi::Error& e) {
                         Napi::Number::New(env, this->errorCode)};
   Napi::Value error = FSUIPCError.Value().As<Napi::Function>().New(2, args);
 
-  this->deferred.Reject(error);
-}
-
-Napi::Value ProcessAsyncWorker::GetValue(Type type, void* data, size_t length) {
-  Napi::Env env = this->Env();
-  Napi::EscapableHandleScope scope(env);
-
-  switch (type) {
-    case Type::Byte:
-      return scope.Escape(Napi::Value::From(env, *((uint8_t*)data)));
-    case Type::SByte:
-      return scope.Escape(Napi::Value::From(env, *((int8_t*)data)));
-    case Type::Int16:
-      return scope.Escape(Napi::Value::From(env, *((int16_t*)data)));
-    case Type::Int32:
-      return scope.Escape(Napi::Value::From(env, *((int32_t*)data)));
-    case Type::Int64:
-      return scope.Escape(
-          Napi::Value::From(env, std::to_string(*((int64_t*)data))));
-    case Type::UInt16:
-      return scope.Escape(Napi::Value::From(env, *((uint16_t*)data)));
-    case Type::UInt32:
-      return scope.Escape(Napi::Value::From(env, *((uint32_t*)data)));
-    case Type::UInt64:
-      return scope.Escape(
-          Napi::Value::From(env, std::to_string(*((uint64_t*)data))));
-    case Type::Double:
-      return scope.Escape(Napi::Value::From(env, *((double*)data)));
-    case Type::Single:
-      return scope.Escape(Napi::Value::From(env, *((float*)data)));
-    case Type::String: {
-      char* str = (char*)data;
-      return scope.Escape(Napi::Value::From(env, str));
-    }
-    case Type::BitArray: {
-      Napi::Array arr = Napi::Array::New(env, length * 8);
-      uint8_t* bits = (uint8_t*)data;
-      for (int i = 0; i < length * 8; i++) {
-        int byte_index = i / 8;
-        int bit_index = i % 8;
-        int mask = 1 << bit_index;
-        bool value = (bits[byte_index] & mask) != 0;
-        arr.Set(i, Napi::Value::From(env, value));
-      }
-      return scope.Escape(arr);
-    }
-    case Type::ByteArray: {
-      Napi::Array arr = Napi::Array::New(env, length);
-      uint8_t* bytes = (uint8_t*)data;
-      for (int i = 0; i < length; i++) {
-        arr.Set(i, Napi::Value::From(env, *bytes));
-        bytes++;
-      }
-      return scope.Escape(arr);
+  auto end = std::chrono::steady_clock::now();
+  for (const Waiter& waiter : this->waiters) {
+    this->fsuipc->stats.total.Record(end - waiter.queued);
+    if (waiter.abort && !waiter.abort->Settle()) {
+      continue;
     }
+    waiter.deferred.Reject(error);
   }
-
-  return scope.Escape(env.Undefined());
-}
-
-DWORD get_size_of_type(Type type) {
-  switch (type) {
-    case Type::Byte:
-    case Type::SByte:
-      return 1;
-    case Type::Int16:
-    case Type::UInt16:
-      return 2;
-    case Type::Int32:
-    case Type::UInt32:
-      return 4;
-    case Type::Int64:
-    case Type::UInt64:
-      return 8;
-    case Type::Double:
-      return 8;
-    case Type::Single:
-      return 4;
-  }
-  return 0;
 }
 
 void OpenAsyncWorker::Execute() {
   Error result;
 
+  TraceSpan span(&this->fsuipc->tracer, "open");
+
   std::lock_guard<std::mutex> fsuipc_guard(this->fsuipc->fsuipc_mutex);
 
+  this->fsuipc->ipc->SetRetryPolicy(
+      this->fsuipc->DefaultPolicy(RetryPolicy::Clock::now()));
   if (!this->fsuipc->ipc->Open(this->requestedSim, &result)) {
     this->SetError(ErrorToString(result));
     this->errorCode = static_cast<int>(result);
     return;
   }
+
+  this->fsuipc->requested_sim = this->requestedSim;
+  this->fsuipc->SetState(ConnectionState::CONNECTED, Error::OK);
 }
 
 void OpenAsyncWorker::OnOK() {
   Napi::Env env = this->Env();
   Napi::HandleScope scope(env);
 
+  // A supervisor that is still running is kept, one that was stopped by
+  // close() is joined by then, as its worker ran before this one
+  FSUIPC* fsuipc = this->fsuipc;
+  if (fsuipc->reconnect && !fsuipc->supervisor) {
+    fsuipc->supervisor_stopping = false;
+    fsuipc->supervisor.reset(new Poller());
+    fsuipc->supervisor->Start(fsuipc->probe_interval,
+                              [fsuipc] { fsuipc->Supervise(); });
+  }
+
   this->deferred.Resolve(this->fsuipc->Value());
 }
 
@@ -587,10 +1924,61 @@ void OpenAsyncWorker::OnError(const Napi::Error& e) {
   this->deferred.Reject(error);
 }
 
+void WriteNowAsyncWorker::Execute() {
+  Error result;
+
+  TraceSpan span(&this->fsuipc->tracer, "writeNow");
+
+  std::lock_guard<std::mutex> fsuipc_guard(this->fsuipc->fsuipc_mutex);
+
+  if (this->fsuipc->state == ConnectionState::RECONNECTING) {
+    this->fsuipc->Reconnect();
+  }
+
+  IPCUser* ipc = this->fsuipc->ipc;
+  ipc->SetRetryPolicy(this->fsuipc->DefaultPolicy(RetryPolicy::Clock::now()));
+  bool ok = this->fsuipc->RunCycle(&result, true);
+  ipc->SetRetryPolicy(this->fsuipc->retry_policy);
+
+  if (!ok) {
+    this->SetError(ErrorToString(result));
+    this->errorCode = static_cast<int>(result);
+  }
+}
+
+void WriteNowAsyncWorker::OnOK() {
+  Napi::Env env = this->Env();
+  Napi::HandleScope scope(env);
+
+  this->deferred.Resolve(env.Undefined());
+}
+
+void WriteNowAsyncWorker::OnError(const Napi::Error& e) {
+  Napi::Env env = this->Env();
+  Napi::HandleScope scope(env);
+
+  napi_value args[2] = {Napi::String::New(env, e.Message()),
+                        Napi::Number::New(env, this->errorCode)};
+  Napi::Value error = FSUIPCError.Value().As<Napi::Function>().New(2, args);
+
+  this->deferred.Reject(error);
+}
+
 void CloseAsyncWorker::Execute() {
+  this->supervisor.reset();
+  if (this->subscription) {
+    this->subscription->poller.Stop();
+    this->subscription->callback.Release();
+  }
+
   std::lock_guard<std::mutex> fsuipc_guard(this->fsuipc->fsuipc_mutex);
 
   this->fsuipc->ipc->Close();
+  this->fsuipc->SetState(ConnectionState::CLOSED, Error::OK);
+
+  // Writes are not sent to a sim that is opened later
+  this->fsuipc->write_inbox.Drain(&this->fsuipc->write_queue);
+  this->fsuipc->write_queue.Clear();
 }
 
 void CloseAsyncWorker::OnOK() {
@@ -600,6 +1988,20 @@ void CloseAsyncWorker::OnOK() {
   this->deferred.Resolve(this->fsuipc->Value());
 }
 
+void UnsubscribeAsyncWorker::Execute() {
+  if (this->subscription) {
+    this->subscription->poller.Stop();
+    this->subscription->callback.Release();
+  }
+}
+
+void UnsubscribeAsyncWorker::OnOK() {
+  Napi::Env env = this->Env();
+  Napi::HandleScope scope(env);
+
+  this->deferred.Resolve(env.Undefined());
+}
+
 void InitType(Napi::Env env, Napi::Object exports) {
   Napi::Object obj = Napi::Object::New(env);
   obj.DefineProperty(Napi::PropertyDescriptor::Value(
@@ -685,6 +2087,11 @@ void InitError(Napi::Env env, Napi::Object exports) {
   obj.DefineProperty(Napi::PropertyDescriptor::Value(
       "NOPERMISSION",
       Napi::Value::From(env, static_cast<int>(Error::NOPERMISSION))));
+  obj.DefineProperty(Napi::PropertyDescriptor::Value(
+      "CANCELLED",
+      Napi::Value::From(env, static_cast<int>(Error::CANCELLED))));
+  obj.DefineProperty(Napi::PropertyDescriptor::Value(
+      "DEADLINE", Napi::Value::From(env, static_cast<int>(Error::DEADLINE))));
 
   exports.Set("ErrorCode", obj);
 }
@@ -723,4 +2130,20 @@ void InitSimulator(Napi::Env env, Napi::Object exports) {
   exports.Set("Simulator", obj);
 }
 
+void InitConnectionState(Napi::Env env, Napi::Object exports) {
+  Napi::Object obj = Napi::Object::New(env);
+  obj.DefineProperty(Napi::PropertyDescriptor::Value(
+      "CLOSED",
+      Napi::Value::From(env, static_cast<int>(ConnectionState::CLOSED))));
+  obj.DefineProperty(Napi::PropertyDescriptor::Value(
+      "CONNECTED",
+      Napi::Value::From(env, static_cast<int>(ConnectionState::CONNECTED))));
+  obj.DefineProperty(Napi::PropertyDescriptor::Value(
+      "RECONNECTING",
+      Napi::Value::From(env,
+                        static_cast<int>(ConnectionState::RECONNECTING))));
+
+  exports.Set("ConnectionState", obj);
+}
+
 }  // namespace FSUIPC
@@ -5,56 +5,139 @@
 #include <napi.h>
 #include <winsock2.h>
 
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
+#include "ChangeTracker.h"
+#include "Codec.h"
+#include "Cycle.h"
+#include "Filter.h"
+#include "IOThread.h"
 #include "IPCUser.h"
+#include "Poller.h"
+#include "Published.h"
+#include "ReadPlan.h"
+#include "Registry.h"
+#include "RetryPolicy.h"
+#include "Scheduler.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "Type.h"
+#include "WriteBatch.h"
+#include "WriteInbox.h"
+#include "WriteQueue.h"
 
 namespace FSUIPC {
-enum class Type {
-  Byte,
-  SByte,
-  Int16,
-  Int32,
-  Int64,
-  UInt16,
-  UInt32,
-  UInt64,
-  Double,
-  Single,
-  ByteArray,
-  String,
-  BitArray,
-};
-
 void InitType(Napi::Env env, Napi::Object exports);
 void InitError(Napi::Env env, Napi::Object exports);
 void InitSimulator(Napi::Env env, Napi::Object exports);
+void InitConnectionState(Napi::Env env, Napi::Object exports);
 
-DWORD get_size_of_type(Type type);
+enum class ConnectionState : int {
+  CLOSED = 0,
+  CONNECTED = 1,
+  // The link was lost and is being restored, see the reconnect option
+  RECONNECTING = 2,
+};
 
-struct Offset {
+// An offset as seen by the getters of lazy results
+struct LazyField {
   std::string name;
-  Type type;
-  DWORD offset;
+  const Codec* codec;
+  size_t slot;
   DWORD size;
-  void* dest;
 };
 
-struct OffsetWrite {
-  Type type;
-  DWORD offset;
-  DWORD size;
-  void* src;  // Will be freed on Process()
+// Backs a lazy result: a copy of the slab and the layout it was copied with
+struct LazyResult {
+  std::shared_ptr<const std::vector<LazyField>> fields;
+  std::vector<BYTE> slab;
 };
 
+// A version of the offsets as published by add(), remove() and setGroup(),
+// never changed once published
+struct OffsetSet {
+  Registry registry;
+  // Codec of each handle
+  std::vector<const Codec*> codecs;
+  // Filter of each handle, applied by processChanges()
+  std::vector<Filter> filters;
+  std::map<std::string, std::chrono::microseconds> intervals;
+};
+
+enum class ProcessMode {
+  Object,   // Resolve with an object with a property per offset
+  Raw,      // Resolve with a copy of the slab in a new ArrayBuffer
+  Into,     // Copy the slab into the caller's buffer
+  Changes,  // Resolve with the offsets that changed since the previous cycle
+  Lazy,     // Like Object, but values are decoded when first accessed
+};
+
+// How a process() call wants its cycle to be bounded
+struct ProcessOptions {
+  ProcessMode mode = ProcessMode::Object;
+  // Time after which the call gives up, none if max()
+  RetryPolicy::Clock::time_point deadline =
+      RetryPolicy::Clock::time_point::max();
+  // AbortSignal that rejects the call, may be empty
+  Napi::Object signal;
+  // Generation of the layout the caller reads the result with, see layout()
+  uint64_t generation = 0;
+};
+
+// Shared by a cycle and the abort listeners of the calls that joined it, as
+// a listener can run before or after the cycle
+struct CycleCancel {
+  // Calls that haven't been aborted, only used on the main thread
+  size_t live = 0;
+  // Set once every call has been aborted, checked by the retry policy
+  std::atomic<bool> cancelled{false};
+};
+
+// A subscribe() call and its delivery to JS. Once unsubscribed, its thread
+// is joined on the IO thread, and it is deleted after JS has had its last
+// frame, so a new subscription can start meanwhile.
+struct Subscription {
+  Poller poller;
+  // Raised before the poller is stopped, cancels the tick's cycle
+  std::atomic<bool> stopping{false};
+  Napi::ThreadSafeFunction callback;
+  bool lazy = false;
+
+  // With subscribe({ changes: true }) only the offsets that changed and pass
+  // their filter are delivered. The tracker and tick_changed are guarded by
+  // fsuipc_mutex.
+  bool changes = false;
+  ChangeTracker tracker;
+  std::vector<Handle> tick_changed;
+
+  // Only the latest frame is kept, so frames produced while JS is busy are
+  // dropped. frame_changed collects the changes of the frames JS hasn't
+  // picked up yet.
+  std::mutex frame_mutex;
+  std::vector<BYTE> frame;
+  std::shared_ptr<const OffsetSet> frame_set;
+  Error frame_error;
+  std::atomic<bool> frame_pending{false};
+  std::vector<Handle> frame_changed;
+  uint64_t frame_cycle = 0;
+};
+
+class IOWorker;
+class ProcessAsyncWorker;
+
 // https://medium.com/netscape/tutorial-building-native-c-modules-for-node-js-using-nan-part-1-755b07389c7c
 class FSUIPC : public Napi::ObjectWrap<FSUIPC> {
+  friend class IOWorker;
   friend class ProcessAsyncWorker;
   friend class OpenAsyncWorker;
   friend class CloseAsyncWorker;
+  friend class WriteNowAsyncWorker;
 
  public:
   static void Init(Napi::Env env, Napi::Object exports);
@@ -64,59 +147,289 @@ class FSUIPC : public Napi::ObjectWrap<FSUIPC> {
   Napi::Value Close(const Napi::CallbackInfo& info);
 
   Napi::Value Process(const Napi::CallbackInfo& info);
+  Napi::Value QueueProcess(Napi::Env env,
+                           const ProcessOptions& options,
+                           Napi::Object target = Napi::Object());
+  Napi::Value ProcessRaw(const Napi::CallbackInfo& info);
+  Napi::Value ProcessInto(const Napi::CallbackInfo& info);
+  Napi::Value ProcessChanges(const Napi::CallbackInfo& info);
+  Napi::Value Layout(const Napi::CallbackInfo& info);
   Napi::Value Add(const Napi::CallbackInfo& info);
   Napi::Value Remove(const Napi::CallbackInfo& info);
+  void SetGroup(const Napi::CallbackInfo& info);
   void Write(const Napi::CallbackInfo& info);
+  Napi::Value WriteNow(const Napi::CallbackInfo& info);
+  void WriteBits(const Napi::CallbackInfo& info);
+  Napi::Value WriteBatch(const Napi::CallbackInfo& info);
+
+  Napi::Value Subscribe(const Napi::CallbackInfo& info);
+  Napi::Value Unsubscribe(const Napi::CallbackInfo& info);
+
+  Napi::Value GetStats(const Napi::CallbackInfo& info);
+  void ResetStats(const Napi::CallbackInfo& info);
+
+  void StartTrace(const Napi::CallbackInfo& info);
+  void StopTrace(const Napi::CallbackInfo& info);
+  Napi::Value DumpTrace(const Napi::CallbackInfo& info);
+
+  void OnStateChange(const Napi::CallbackInfo& info);
+  Napi::Value GetConnectionState(const Napi::CallbackInfo& info);
 
   static Napi::FunctionReference constructor;
 
   ~FSUIPC() {
+    this->supervisor_stopping = true;
+    this->supervisor.reset();
+    std::shared_ptr<Subscription> subscription = this->StopSubscription();
+    if (subscription) {
+      subscription->poller.Stop();
+    }
+    this->io_thread.Stop();
+    this->io_done.Release();
+    if (this->state_callback) {
+      this->state_callback.Release();
+    }
+
     if (this->ipc) {
       delete this->ipc;
     }
   }
 
  protected:
-  std::map<std::string, Offset> offsets;
-  std::vector<OffsetWrite> offset_writes;
-  std::mutex offsets_mutex;
+  // The offsets as changed by JS, only used on the main thread. Changes are
+  // published as a new OffsetSet once JS returns to the event loop, or right
+  // away by the next process() or subscribe().
+  Registry registry;
+  std::vector<const Codec*> codecs;
+  std::vector<Filter> filters;
+  std::map<std::string, std::chrono::microseconds> intervals;
+  bool publish_pending = false;
+  Published<OffsetSet> offset_set;
+  void SchedulePublish();
+  void Publish();
+
+  // The cycle's own copy of the latest OffsetSet, with the values read into
+  // its slab. This and everything below that is used by cycles is guarded by
+  // fsuipc_mutex, which JS never waits for.
+  std::shared_ptr<const OffsetSet> live_set;
+  Registry live;
+  // Switches to the latest OffsetSet, keeping the values of the offsets that
+  // are still registered
+  void Adopt(std::shared_ptr<const OffsetSet> set);
+
+  // Writes of any thread, drained into write_queue by each cycle. Writes of
+  // a cycle that failed stay in write_queue, ahead of later ones.
+  WriteInbox write_inbox;
+  WriteQueue write_queue;
   std::mutex fsuipc_mutex;
   IPCUser* ipc;
+
+  // Read plans of each group, rebuilt whenever a cycle adopts offsets that
+  // were added or removed
+  Scheduler scheduler;
+  DWORD coalesce_gap = 16;
+
+  // Bytes of the previous processChanges()
+  ChangeTracker change_tracker;
+
+  // Retries of every round trip, and the time a cycle or open() may take
+  // unless a call asks for a deadline of its own
+  RetryPolicy retry_policy;
+  std::chrono::milliseconds default_deadline{10000};
+  // retry_policy with the default deadline counted from start
+  RetryPolicy DefaultPolicy(RetryPolicy::Clock::time_point start) const;
+
+  // Runs open(), close() and process() one at a time, and completes them on
+  // the main thread through io_done, which keeps the event loop alive while
+  // any are outstanding
+  IOThread io_thread;
+  Napi::ThreadSafeFunction io_done;
+  size_t io_outstanding = 0;
+
+  // With reconnect, a lost link is restored by the supervisor thread, or by
+  // the next cycle if that comes first. The registry and queued writes are
+  // kept meanwhile, and state changes are reported instead of errors.
+  bool reconnect = false;
+  std::chrono::milliseconds probe_interval{100};
+  Simulator requested_sim = Simulator::ANY;
+  std::atomic<ConnectionState> state{ConnectionState::CLOSED};
+  // Joined on the IO thread by close(), a probe may be waiting for a hung sim
+  std::unique_ptr<Poller> supervisor;
+  std::atomic<bool> supervisor_stopping{false};
+  // Read every group in the first cycle after reconnecting
+  std::atomic<bool> expire_groups{false};
+  Napi::ThreadSafeFunction state_callback;
+  std::mutex state_mutex;
+
+  void SetState(ConnectionState state, Error cause);
+  // Whether a failed cycle means the sim went away, rather than that it was
+  // slow or the call gave up
+  bool LinkLost(Error error) const;
+  // Reopens the link if the sim is back, the caller must hold fsuipc_mutex.
+  // Gives up when cancelled is raised, supervisor_stopping by default.
+  bool Reconnect(const std::atomic<bool>* cancelled = nullptr);
+  void Supervise();
+
+  // Runs the read plan and the queued writes, or only the writes, the caller
+  // must hold fsuipc_mutex
+  bool RunCycle(Error* result, bool writesOnly = false);
+  // Resolves the values of all offsets of set from a copy of its slab
+  Napi::Object ToObject(Napi::Env env, const OffsetSet& set, const BYTE* slab);
+
+  // Same as ToObject, but the values are only decoded when first accessed
+  Napi::Object ToLazyObject(Napi::Env env,
+                            const OffsetSet& set,
+                            const BYTE* slab);
+
+  // Resolves the handles and values of the changed offsets of set, as
+  // returned by processChanges()
+  Napi::Object ToChanges(Napi::Env env,
+                         const OffsetSet& set,
+                         const BYTE* slab,
+                         const std::vector<Handle>& changed,
+                         uint64_t cycle);
+
+  // Property keys of the result object in registry order, kept until offsets
+  // are added or removed
+  Napi::ObjectReference result_keys;
+  uint64_t result_generation = 0;
+  std::vector<Napi::PropertyDescriptor> result_properties;
+  Napi::Object ResultKeys(Napi::Env env, const Registry& registry);
+
+  // Prototype of lazy results with a getter per offset, kept until offsets
+  // are added or removed
+  Napi::ObjectReference lazy_prototype;
+  std::shared_ptr<const std::vector<LazyField>> lazy_fields;
+  uint64_t lazy_generation = 0;
+  Napi::FunctionReference object_create;
+
+  // The running subscription, only used on the main thread
+  std::shared_ptr<Subscription> subscription;
+
+  Stats stats;
+  Tracer tracer;
+
+  // The process() cycle that hasn't started yet. Calls made until it starts
+  // share it, instead of each doing a round trip of its own.
+  ProcessAsyncWorker* pending_worker = nullptr;
+  std::mutex pending_mutex;
+
+  void Tick(Subscription* subscription);
+  void Deliver(Subscription* subscription,
+               Napi::Env env,
+               Napi::Function callback);
+  // Cancels the running subscription's tick, and hands the subscription over
+  // to be joined off the main thread. Returns null if there is none.
+  std::shared_ptr<Subscription> StopSubscription();
 };
 
-class ProcessAsyncWorker : public Napi::AsyncWorker {
+// Like Napi::AsyncWorker, but Execute() runs on the connection's IO thread
+// instead of the libuv threadpool. OnOK() or OnError() then run on the main
+// thread, and the worker deletes itself. The FSUIPC object is kept alive
+// until then.
+class IOWorker {
  public:
   FSUIPC* fsuipc;
 
-  ProcessAsyncWorker(Napi::Env& env,
-                     Napi::Promise::Deferred deferred,
-                     FSUIPC* fsuipc)
-      : Napi::AsyncWorker(env), deferred(deferred), fsuipc(fsuipc) {}
+  IOWorker(Napi::Env& env, FSUIPC* fsuipc) : fsuipc(fsuipc), env(env) {}
+  virtual ~IOWorker() {}
+
+  // Urgent workers run before the workers that are already queued
+  void Queue(bool urgent = false);
+  Napi::Env Env() const { return this->env; }
+
+ protected:
+  virtual void Execute() = 0;
+
+  virtual void OnOK() {}
+  virtual void OnError(const Napi::Error& e) {}
+  void SetError(const std::string& error) { this->error = error; }
+
+ private:
+  Napi::Env env;
+  std::string error;
+
+  void Complete();
+};
+
+// Runs a single cycle for every process() call made before it starts
+class ProcessAsyncWorker : public IOWorker {
+ public:
+  ProcessAsyncWorker(Napi::Env& env, FSUIPC* fsuipc)
+      : IOWorker(env, fsuipc), cancel(std::make_shared<CycleCancel>()) {}
+
+  // Adds a call that is settled with the result of this cycle. The caller
+  // must hold the FSUIPC's pending_mutex, and Execute() must not have
+  // started. No JS runs meanwhile: the listener to add to the call's
+  // AbortSignal is returned instead, empty if it has none.
+  Napi::Function Join(Napi::Env env,
+                      Napi::Promise::Deferred deferred,
+                      const ProcessOptions& options,
+                      Napi::Object target = Napi::Object());
+
+  // Whether every call that joined has been aborted
+  bool Cancelled() const { return this->cancel->cancelled; }
 
   void Execute() override;
 
   void OnOK() override;
   void OnError(const Napi::Error& e) override;
 
-  Napi::Value GetValue(Type type, void* data, size_t length);
-
  private:
+  // A call's link to its AbortSignal, shared with the abort listener
+  struct Abort {
+    Napi::Promise::Deferred deferred;
+    Napi::ObjectReference signal;
+    Napi::FunctionReference listener;
+    // Set once the call is settled, by the cycle or by the listener
+    bool settled = false;
+
+    // Marks the call settled and removes the listener, returns false if it
+    // already was
+    bool Settle();
+  };
+
+  struct Waiter {
+    Napi::Promise::Deferred deferred;
+    ProcessMode mode;
+    // Buffer to copy the slab into for ProcessMode::Into
+    Napi::ObjectReference target;
+    std::chrono::steady_clock::time_point queued;
+    std::shared_ptr<Abort> abort;
+    // Generation of the layout the caller expects for ProcessMode::Into
+    uint64_t generation;
+  };
+
   int errorCode;
-  Napi::Promise::Deferred deferred;
+  std::vector<Waiter> waiters;
+  std::shared_ptr<CycleCancel> cancel;
+  // Latest deadline of the calls that joined, or whether any call uses the
+  // default deadline instead
+  RetryPolicy::Clock::time_point deadline =
+      RetryPolicy::Clock::time_point::min();
+  bool unbounded = false;
+  bool tracked = false;
+  // The offsets the cycle ran with and a copy of their values, so results
+  // are built without touching the cycle's state
+  std::shared_ptr<const OffsetSet> set;
+  std::vector<BYTE> snapshot;
+  std::vector<Handle> changed;
+  uint64_t cycle;
+  std::chrono::steady_clock::time_point queued =
+      std::chrono::steady_clock::now();
+
+  void Resolve(Napi::Env env, Waiter& waiter);
 };
 
-class OpenAsyncWorker : public Napi::AsyncWorker {
+class OpenAsyncWorker : public IOWorker {
  public:
-  FSUIPC* fsuipc;
-
   OpenAsyncWorker(Napi::Env& env,
                   Napi::Promise::Deferred deferred,
                   FSUIPC* fsuipc,
                   Simulator requestedSim)
-      : Napi::AsyncWorker(env),
-        deferred(deferred),
-        fsuipc(fsuipc),
-        requestedSim(requestedSim) {}
+      : IOWorker(env, fsuipc),
+        requestedSim(requestedSim),
+        deferred(deferred) {}
 
   void Execute() override;
 
@@ -129,14 +442,60 @@ class OpenAsyncWorker : public Napi::AsyncWorker {
   Napi::Promise::Deferred deferred;
 };
 
-class CloseAsyncWorker : public Napi::AsyncWorker {
+// Sends the queued writes in a write-only transaction, ahead of the cycles
+// that are queued
+class WriteNowAsyncWorker : public IOWorker {
  public:
-  FSUIPC* fsuipc;
+  WriteNowAsyncWorker(Napi::Env& env,
+                      Napi::Promise::Deferred deferred,
+                      FSUIPC* fsuipc)
+      : IOWorker(env, fsuipc), deferred(deferred) {}
+
+  void Execute() override;
+
+  void OnOK() override;
+  void OnError(const Napi::Error& e) override;
+
+ private:
+  int errorCode;
+  Napi::Promise::Deferred deferred;
+};
 
+// Joins the threads of the supervisor and subscription, which may be
+// waiting for a hung sim, before closing
+class CloseAsyncWorker : public IOWorker {
+ public:
   CloseAsyncWorker(Napi::Env& env,
                    Napi::Promise::Deferred deferred,
-                   FSUIPC* fsuipc)
-      : Napi::AsyncWorker(env), deferred(deferred), fsuipc(fsuipc) {}
+                   FSUIPC* fsuipc,
+                   std::unique_ptr<Poller> supervisor,
+                   std::shared_ptr<Subscription> subscription)
+      : IOWorker(env, fsuipc),
+        deferred(deferred),
+        supervisor(std::move(supervisor)),
+        subscription(subscription) {}
+
+  void Execute() override;
+
+  void OnOK() override;
+
+ private:
+  Napi::Promise::Deferred deferred;
+  std::unique_ptr<Poller> supervisor;
+  std::shared_ptr<Subscription> subscription;
+};
+
+// Joins the thread of a subscription that was stopped, ahead of the cycles
+// that are queued
+class UnsubscribeAsyncWorker : public IOWorker {
+ public:
+  UnsubscribeAsyncWorker(Napi::Env& env,
+                         Napi::Promise::Deferred deferred,
+                         FSUIPC* fsuipc,
+                         std::shared_ptr<Subscription> subscription)
+      : IOWorker(env, fsuipc),
+        deferred(deferred),
+        subscription(subscription) {}
 
   void Execute() override;
 
@@ -144,6 +503,7 @@ class CloseAsyncWorker : public Napi::AsyncWorker {
 
  private:
   Napi::Promise::Deferred deferred;
+  std::shared_ptr<Subscription> subscription;
 };
 
 }  // namespace FSUIPC
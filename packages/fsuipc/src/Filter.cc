@@ -0,0 +1,64 @@
+#include "Filter.h"
+
+#include <cmath>
+
+namespace FSUIPC {
+
+bool IsNumeric(Type type) {
+  return (unsigned)type <= (unsigned)Type::Single;
+}
+
+static double ToDouble(Type type, const BYTE* data) {
+  switch (type) {
+    case Type::Byte:
+      return Load<Type::Byte>(data);
+    case Type::SByte:
+      return Load<Type::SByte>(data);
+    case Type::Int16:
+      return Load<Type::Int16>(data);
+    case Type::Int32:
+      return Load<Type::Int32>(data);
+    case Type::Int64:
+      return (double)Load<Type::Int64>(data);
+    case Type::UInt16:
+      return Load<Type::UInt16>(data);
+    case Type::UInt32:
+      return Load<Type::UInt32>(data);
+    case Type::UInt64:
+      return (double)Load<Type::UInt64>(data);
+    case Type::Double:
+      return Load<Type::Double>(data);
+    case Type::Single:
+      return Load<Type::Single>(data);
+    default:
+      return 0;
+  }
+}
+
+bool Filter::Passes(Type type,
+                    const BYTE* value,
+                    const BYTE* reported,
+                    Clock::duration elapsed) const {
+  if (elapsed < this->minInterval) {
+    return false;
+  }
+
+  if ((this->deadband == 0 && this->relative == 0) || !IsNumeric(type)) {
+    return true;
+  }
+
+  double current = ToDouble(type, value);
+  double previous = ToDouble(type, reported);
+  double delta = std::fabs(current - previous);
+
+  // NaN never compares, so a change from or to it is always reported
+  if (std::isnan(delta)) {
+    return true;
+  }
+
+  // Either deadband lets the change through, one that is 0 is not used
+  return (this->deadband > 0 && delta > this->deadband) ||
+         (this->relative > 0 && delta > this->relative * std::fabs(previous));
+}
+
+}  // namespace FSUIPC
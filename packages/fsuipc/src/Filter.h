@@ -0,0 +1,46 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <chrono>
+
+#include "Platform.h"
+#include "Type.h"
+
+namespace FSUIPC {
+
+// Decides which changes of an offset are reported by ChangeTracker, set by
+// the options of add(). Values are compared with the value that was last
+// reported, so a slow drift is still reported once it adds up.
+struct Filter {
+  typedef std::chrono::steady_clock Clock;
+
+  // A numeric value is only reported once it moved by more than this, or by
+  // more than relative times the reported value. Either one that is 0 is
+  // not used.
+  double deadband = 0;
+  double relative = 0;
+  // Changes within this time of the last report wait for the next cycle
+  // after it
+  std::chrono::microseconds minInterval{0};
+  // The value is reported again after this time even if it didn't change,
+  // 0 disables it
+  std::chrono::microseconds maxInterval{0};
+
+  bool Empty() const {
+    return this->deadband == 0 && this->relative == 0 &&
+           this->minInterval.count() == 0 && this->maxInterval.count() == 0;
+  }
+
+  // Whether a value that differs from the last reported one is reported
+  bool Passes(Type type,
+              const BYTE* value,
+              const BYTE* reported,
+              Clock::duration elapsed) const;
+};
+
+// Whether the type is compared by its value instead of its bytes
+bool IsNumeric(Type type);
+
+}  // namespace FSUIPC
+
+#endif
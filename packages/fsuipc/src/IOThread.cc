@@ -0,0 +1,55 @@
+#include "IOThread.h"
+
+namespace FSUIPC {
+
+void IOThread::Post(std::function<void()> job, bool urgent) {
+  std::lock_guard<std::mutex> guard(this->mutex);
+
+  if (!this->thread.joinable()) {
+    this->stopping = false;
+    this->thread = std::thread(&IOThread::Run, this);
+  }
+
+  if (urgent) {
+    this->jobs.insert(this->jobs.begin() + this->urgent++, std::move(job));
+  } else {
+    this->jobs.push_back(std::move(job));
+  }
+  this->cv.notify_one();
+}
+
+void IOThread::Stop() {
+  {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (!this->thread.joinable()) {
+      return;
+    }
+    this->stopping = true;
+  }
+  this->cv.notify_all();
+
+  this->thread.join();
+}
+
+void IOThread::Run() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (true) {
+    this->cv.wait(lock,
+                  [this] { return this->stopping || !this->jobs.empty(); });
+    if (this->jobs.empty()) {
+      return;
+    }
+
+    std::function<void()> job = std::move(this->jobs.front());
+    this->jobs.pop_front();
+    if (this->urgent > 0) {
+      this->urgent--;
+    }
+
+    lock.unlock();
+    job();
+    lock.lock();
+  }
+}
+
+}  // namespace FSUIPC
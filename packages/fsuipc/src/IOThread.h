@@ -0,0 +1,38 @@
+#ifndef IOTHREAD_H
+#define IOTHREAD_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace FSUIPC {
+
+// Runs jobs one at a time, in the order they were posted, on a thread owned
+// by a single connection. A sim that stops answering then only holds up the
+// calls to that connection, instead of the threadpool shared by the process.
+class IOThread {
+ public:
+  ~IOThread() { this->Stop(); }
+
+  // Starts the thread on first use. Urgent jobs run before the jobs that are
+  // waiting, in the order they were posted themselves.
+  void Post(std::function<void()> job, bool urgent = false);
+  // Runs the jobs that were already posted and joins the thread
+  void Stop();
+
+ private:
+  void Run();
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::function<void()>> jobs;
+  size_t urgent = 0;  // Urgent jobs at the front of jobs
+  bool stopping = false;
+};
+
+}  // namespace FSUIPC
+
+#endif
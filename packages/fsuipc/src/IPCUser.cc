@@ -1,45 +1,27 @@
 #include "IPCUser.h"
 
-#define MSGNAME "FsasmLib:IPC"
+#include <chrono>
 
-#define MAX_SIZE \
-  0x7F00  // Largest data (kept below 32k to avoid any possible 16-bit sign
-          // problems)
+#include "Protocol.h"
 
-#define FS6IPC_MESSAGE_SUCCESS 1
-#define FS6IPC_MESSAGE_FAILURE 0
-
-// IPC message types
-#define F64IPC_READSTATEDATA_ID 1
-#define FS6IPC_WRITESTATEDATA_ID 2
-
-#pragma pack(push, r1, 1)
-// read request structure
-typedef struct tagF64IPC_READSTATEDATA_HDR {
-  DWORD dwId;      // F64IPC_READSTATEDATA_ID
-  DWORD dwOffset;  // state table offset
-  DWORD nBytes;    // number of bytes of state data to read
-  uint32_t pDest;  // destination buffer for data (client use only)
-} F64IPC_READSTATEDATA_HDR;
-
-// write request structure
-typedef struct tagFS6IPC_WRITESTATEDATA_HDR {
-  DWORD dwId;      // FS6IPC_WRITESTATEDATA_ID
-  DWORD dwOffset;  // state table offset
-  DWORD nBytes;    // number of bytes of state data to write
-} FS6IPC_WRITESTATEDATA_HDR;
-
-#pragma pack(pop, r1)
+#ifdef _WIN32
+#include "WindowsTransport.h"
+#else
+#include "ShmTransport.h"
+#endif
 
 namespace FSUIPC {
-bool IPCUser::Open(Simulator requestedVersion, Error* result) {
-  char szName[MAX_PATH];
-  static int nTry = 0;
-  bool isWideFS = false;
-  int i = 0;
+IPCUser::IPCUser() {
+#ifdef _WIN32
+  this->transport = new WindowsTransport();
+#else
+  this->transport = new ShmTransport();
+#endif
+}
 
+bool IPCUser::Open(Simulator requestedVersion, Error* result) {
   // abort if already started
-  if (this->viewPointer) {
+  if (!this->frames.empty()) {
     *result = Error::OPEN;
     return false;
   }
@@ -47,71 +29,28 @@ bool IPCUser::Open(Simulator requestedVersion, Error* result) {
   // Clear version information, so know when connected
   this->Version = this->FSVersion = 0;
 
-  // Connect via FSUIPC, which is known to be FSUIPC's own
-  // and isn't subject to user modification
-  this->windowHandle = FindWindowEx(nullptr, nullptr, "UIPCMAIN", nullptr);
-  if (!this->windowHandle) {
-    // If there's no UIPCMAIN, we may be using WideClient,
-    // which only simulates FS98
-    this->windowHandle = FindWindowEx(nullptr, nullptr, "FS98MAIN", nullptr);
-    isWideFS = true;
-    if (!this->windowHandle) {
-      *result = Error::NOFS;
-      return false;
-    }
-  }
-
-  // Register the window message
-  this->msgId = RegisterWindowMessage(MSGNAME);
-  if (this->msgId == 0) {
-    *result = Error::REGMSG;
+  if (!this->transport->Open(result)) {
     return false;
   }
 
-  // Create the name of our file-mapping object
-  nTry++;  // Ensures a unique string is used in case user closes and reopens
-  wsprintf(szName, MSGNAME, ":%X:%X", GetCurrentProcessId(), nTry);
-
-  // Stuff the name into a global atom
-  this->atom = GlobalAddAtom(szName);
-  if (this->atom == 0) {
-    *result = Error::ATOM;
-    this->Close();
-    return false;
-  }
-
-  // Create the file-mapping object
-  this->mapHandle =
-      CreateFileMapping(INVALID_HANDLE_VALUE,  // Use system paging file
-                        nullptr,               // Security
-                        PAGE_READWRITE,        // Protection
-                        0, MAX_SIZE + 256,     // Size
-                        szName                 // Name
-      );
-  if (this->mapHandle == 0 || GetLastError() == ERROR_ALREADY_EXISTS) {
-    *result = Error::MAP;
-    this->Close();
-    return false;
-  }
-
-  // Get a view of the file-mapping object
-  this->viewPointer =
-      (BYTE*)MapViewOfFile(this->mapHandle, FILE_MAP_WRITE, 0, 0, 0);
-  if (this->viewPointer == nullptr) {
-    *result = Error::VIEW;
-    this->Close();
-    return false;
+  this->frames.resize(this->transport->Views());
+  for (unsigned view = 0; view < this->frames.size(); view++) {
+    this->frames[view].viewPointer = this->transport->View(view);
+    this->frames[view].nextPointer = this->frames[view].viewPointer;
   }
+  this->selected = 0;
 
   // Now determine FSUIPC version and FS type
-  this->nextPointer = this->viewPointer;
-
-  this->destinations = std::vector<void*>();
 
-  // Try up to 5 times with a 100ms rest between each
+  // Try up to 5 times, backing off between tries as the retry policy says
   // Note that WideClient returns zeroes initially, whilst waiting
   // for the server to get the data
-  while (i++ < 5 && (this->Version == 0) || (this->FSVersion == 0)) {
+  for (unsigned i = 0; i < 5; i++) {
+    if (i > 0 && !this->policy.Backoff(i - 1, result)) {
+      this->Close();
+      return false;
+    }
+
     // Read FSUIPC Version
     if (!this->Read(0x3304, 4, &this->Version, result)) {
       this->Close();
@@ -127,7 +66,7 @@ bool IPCUser::Open(Simulator requestedVersion, Error* result) {
     // Write our library version number to special read-only offset
     // This is to assist diagnostics from FSUIPC logging
     // But only do this on first try
-    if (i == 1 && !this->Write(0x330a, 2, &this->LibVersion, result)) {
+    if (i == 0 && !this->Write(0x330a, 2, &this->LibVersion, result)) {
       this->Close();
       return false;
     }
@@ -139,21 +78,23 @@ bool IPCUser::Open(Simulator requestedVersion, Error* result) {
     }
 
     // Maybe running on WideClient and need another try
-    Sleep(100);
+    if (this->Version != 0 && this->FSVersion != 0) {
+      break;
+    }
   }
 
   // Only allow running on FSUIPC 1.998e or later
   // with correct check pattern 0xFADE
   if (this->Version < 0x19980005 ||
       (this->FSVersion & 0xFFFF0000L) != 0xFADE0000) {
-    *result = isWideFS ? Error::RUNNING : Error::VERSION;
+    *result = this->transport->IsWideClient() ? Error::RUNNING : Error::VERSION;
     this->Close();
     return false;
   }
 
   this->FSVersion &= 0xffff;  // Isolsates the FS version number
   if (requestedVersion != Simulator::ANY &&
-      static_cast<int>(requestedVersion) != this->FSVersion) {
+      static_cast<DWORD>(requestedVersion) != this->FSVersion) {
     *result = Error::WRONGFS;
     this->Close();
     return false;
@@ -164,107 +105,121 @@ bool IPCUser::Open(Simulator requestedVersion, Error* result) {
 }
 
 void IPCUser::Close() {
-  this->windowHandle = 0;
-  this->msgId = 0;
+  this->transport->Close();
+  this->frames.clear();
+  this->selected = 0;
+}
 
-  if (this->atom) {
-    GlobalDeleteAtom(this->atom);
-    this->atom = 0;
+void IPCUser::Discard() {
+  if (this->frames.empty()) {
+    return;
   }
 
-  if (this->viewPointer) {
-    UnmapViewOfFile((LPVOID)this->viewPointer);
-    this->viewPointer = 0;
-  }
+  Frame& frame = this->frames[this->selected];
+  frame.nextPointer = frame.viewPointer;
+  frame.destinations.clear();
+}
+
+bool IPCUser::Process(Error* result) {
+  return this->Process(this->selected, result);
+}
+
+void IPCUser::ProcessAsync() {
+  unsigned view = this->selected;
 
-  if (this->mapHandle) {
-    CloseHandle(this->mapHandle);
-    this->mapHandle = 0;
+  {
+    std::lock_guard<std::mutex> guard(this->sendMutex);
+    this->sending = true;
   }
 
-  this->destinations = std::vector<void*>();
+  this->sender.Post([this, view] {
+    Error result;
+    bool ok = this->Process(view, &result);
+
+    std::lock_guard<std::mutex> guard(this->sendMutex);
+    this->sending = false;
+    this->sendOk = ok;
+    this->sendResult = result;
+    this->sendDone.notify_all();
+  });
 }
 
-bool IPCUser::Process(Error* result) {
-  DWORD_PTR error;
+bool IPCUser::Wait(Error* result) {
+  std::unique_lock<std::mutex> lock(this->sendMutex);
+  this->sendDone.wait(lock, [this] { return !this->sending; });
+
+  *result = this->sendResult;
+  return this->sendOk;
+}
+
+bool IPCUser::Process(unsigned view, Error* result) {
   DWORD* pdw;
 
   F64IPC_READSTATEDATA_HDR* readHeader;
   FS6IPC_WRITESTATEDATA_HDR* writeHeader;
-  int i = 0;
 
-  if (!this->viewPointer) {
+  if (view >= this->frames.size()) {
     *result = Error::NOTOPEN;
-    this->destinations.clear();
     return false;
   }
 
-  if (this->viewPointer == this->nextPointer) {
+  Frame& frame = this->frames[view];
+
+  if (frame.viewPointer == frame.nextPointer) {
     *result = Error::NODATA;
-    this->destinations.clear();
+    frame.destinations.clear();
     return false;
   }
 
-  ZeroMemory(this->nextPointer, 4);  // Terminator
-  this->nextPointer = this->viewPointer;
-
-  // Send the request with 9 retries
-  while (++i < 10 &&
-         !SendMessageTimeout(
-             this->windowHandle,  // FS6 window handle
-             this->msgId,         // Our registered message id
-             this->atom,          // wParam: name of file-mapping object
-             0,           // lParam: offset of request into file-mapping object
-             SMTO_BLOCK,  // Halt this thread until we get a response
-             2000,        // Time-out interval
-             &error       // Return value
-             )) {
-    Sleep(100);
+  ZeroMemory(frame.nextPointer, 4);  // Terminator
+  frame.nextPointer = frame.viewPointer;
+
+  auto start = std::chrono::steady_clock::now();
+  bool sent;
+  {
+    TraceSpan span(this->tracer, "send");
+    sent = this->transport->Send(view, this->policy, result);
   }
 
-  if (i >= 10) {  // Failed all tries?
-    DWORD lastError = GetLastError();
-    if (lastError == 0) {
-      *result = Error::TIMEOUT;
-    } else if (lastError == 5) {
-      /*
-       * Error code 5 means that we don't have permission to communicate with
-       * any window For more information, see:
-       * https://docs.microsoft.com/en-us/windows/win32/debug/system-error-codes--0-499-
-       */
-      *result = Error::NOPERMISSION;
-    } else {
-      *result = Error::SENDMSG;
-    }
-    this->destinations.clear();
-    return false;
+  if (this->stats) {
+    this->stats->send.Record(std::chrono::steady_clock::now() - start);
+    this->stats->transactions++;
+    this->stats->retries += this->transport->Retries();
   }
 
-  if (error != FS6IPC_MESSAGE_SUCCESS) {
-    *result = Error::DATA;  // FSUIPC didn't like something in the data
-    this->destinations.clear();
+  if (!sent) {
+    frame.destinations.clear();
     return false;
   }
 
+  // Replies of loaded requests are copied out of the view by the caller
+  if (frame.destinations.empty()) {
+    *result = Error::OK;
+    return true;
+  }
+
   // Decode and store results of read requests
-  pdw = (DWORD*)this->viewPointer;
+  TraceSpan span(this->tracer, "decode");
+  pdw = (DWORD*)frame.viewPointer;
 
   while (*pdw) {
     switch (*pdw) {
       case F64IPC_READSTATEDATA_ID: {
         readHeader = (F64IPC_READSTATEDATA_HDR*)pdw;
-        this->nextPointer += sizeof(F64IPC_READSTATEDATA_HDR);
-        void* dest = this->destinations.at(readHeader->pDest);
+        frame.nextPointer += sizeof(F64IPC_READSTATEDATA_HDR);
+        void* dest = readHeader->pDest < frame.destinations.size()
+                         ? frame.destinations[readHeader->pDest]
+                         : nullptr;
         if (dest && readHeader->nBytes) {
-          CopyMemory(dest, this->nextPointer, readHeader->nBytes);
+          CopyMemory(dest, frame.nextPointer, readHeader->nBytes);
         }
-        this->nextPointer += readHeader->nBytes;
+        frame.nextPointer += readHeader->nBytes;
         break;
       }
       case FS6IPC_WRITESTATEDATA_ID: {
         // This is a write, so there's no returned data to store
         writeHeader = (FS6IPC_WRITESTATEDATA_HDR*)pdw;
-        this->nextPointer +=
+        frame.nextPointer +=
             sizeof(FS6IPC_WRITESTATEDATA_HDR) + writeHeader->nBytes;
         break;
       }
@@ -275,12 +230,32 @@ bool IPCUser::Process(Error* result) {
       }
     }
 
-    pdw = (DWORD*)this->nextPointer;
+    pdw = (DWORD*)frame.nextPointer;
+  }
+
+  frame.destinations.clear();
+
+  frame.nextPointer = frame.viewPointer;
+  *result = Error::OK;
+  return true;
+}
+
+bool IPCUser::Load(const BYTE* requests, DWORD size, Error* result) {
+  if (this->frames.empty()) {
+    *result = Error::NOTOPEN;
+    return false;
+  }
+
+  Frame& frame = this->frames[this->selected];
+
+  if (frame.nextPointer - frame.viewPointer + size > MAX_SIZE) {
+    *result = Error::SIZE;
+    return false;
   }
 
-  this->destinations.clear();
+  CopyMemory(frame.nextPointer, requests, size);
+  frame.nextPointer += size;
 
-  this->nextPointer = this->viewPointer;
   *result = Error::OK;
   return true;
 }
@@ -290,17 +265,19 @@ bool IPCUser::ReadCommon(bool special,
                          DWORD size,
                          void* dest,
                          Error* result) {
-  F64IPC_READSTATEDATA_HDR* header =
-      (F64IPC_READSTATEDATA_HDR*)this->nextPointer;
-
-  if (!this->viewPointer) {
+  if (this->frames.empty()) {
     *result = Error::NOTOPEN;
     return false;
   }
 
-  if (this->nextPointer - this->viewPointer + size +
-          sizeof(F64IPC_READSTATEDATA_HDR) >
-      MAX_SIZE) {
+  Frame& frame = this->frames[this->selected];
+  F64IPC_READSTATEDATA_HDR* header =
+      (F64IPC_READSTATEDATA_HDR*)frame.nextPointer;
+
+  if (size > MAX_READ_SIZE ||
+      frame.nextPointer - frame.viewPointer + 4 + size +
+              sizeof(F64IPC_READSTATEDATA_HDR) >
+          MAX_SIZE) {
     *result = Error::SIZE;
     return false;
   }
@@ -308,40 +285,42 @@ bool IPCUser::ReadCommon(bool special,
   header->dwId = F64IPC_READSTATEDATA_ID;
   header->dwOffset = offset;
   header->nBytes = size;
-  header->pDest = this->destinations.size();
+  header->pDest = frame.destinations.size();
 
-  this->destinations.push_back(dest);
+  frame.destinations.push_back(dest);
 
   // Initialize the reception area, so rubbish won't be returned
   if (size) {
     if (special) {
-      CopyMemory(&this->nextPointer[sizeof(F64IPC_READSTATEDATA_HDR)], dest,
+      CopyMemory(&frame.nextPointer[sizeof(F64IPC_READSTATEDATA_HDR)], dest,
                  size);
     } else {
-      ZeroMemory(&this->nextPointer[sizeof(F64IPC_READSTATEDATA_HDR)], size);
+      ZeroMemory(&frame.nextPointer[sizeof(F64IPC_READSTATEDATA_HDR)], size);
     }
   }
 
-  this->nextPointer += sizeof(F64IPC_READSTATEDATA_HDR) + size;
+  frame.nextPointer += sizeof(F64IPC_READSTATEDATA_HDR) + size;
 
   *result = Error::OK;
   return true;
 }
 
 bool IPCUser::Write(DWORD offset, DWORD size, void* src, Error* result) {
-  FS6IPC_WRITESTATEDATA_HDR* header =
-      (FS6IPC_WRITESTATEDATA_HDR*)this->nextPointer;
-
   // Check link is open
-  if (!this->viewPointer) {
+  if (this->frames.empty()) {
     *result = Error::NOTOPEN;
     return false;
   }
 
+  Frame& frame = this->frames[this->selected];
+  FS6IPC_WRITESTATEDATA_HDR* header =
+      (FS6IPC_WRITESTATEDATA_HDR*)frame.nextPointer;
+
   // Check whether we have enough space for this request (including terminator)
-  if (this->nextPointer - this->viewPointer + 4 + size +
-          sizeof(F64IPC_READSTATEDATA_HDR) >
-      MAX_SIZE) {
+  if (size > MAX_WRITE_SIZE ||
+      frame.nextPointer - frame.viewPointer + 4 + size +
+              sizeof(FS6IPC_WRITESTATEDATA_HDR) >
+          MAX_SIZE) {
     *result = Error::SIZE;
     return false;
   }
@@ -353,12 +332,12 @@ bool IPCUser::Write(DWORD offset, DWORD size, void* src, Error* result) {
 
   // Copy in the data to be written
   if (size) {
-    CopyMemory(&this->nextPointer[sizeof(FS6IPC_WRITESTATEDATA_HDR)], src,
+    CopyMemory(&frame.nextPointer[sizeof(FS6IPC_WRITESTATEDATA_HDR)], src,
                size);
   }
 
   // Update the pointer to be ready fore more data
-  this->nextPointer += sizeof(FS6IPC_WRITESTATEDATA_HDR) + size;
+  frame.nextPointer += sizeof(FS6IPC_WRITESTATEDATA_HDR) + size;
 
   *result = Error::OK;
   return true;
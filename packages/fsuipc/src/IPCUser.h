@@ -1,76 +1,19 @@
 #ifndef IPCUSER_H
 #define IPCUSER_H
 
-#include <windows.h>
-
+#include <condition_variable>
 #include <mutex>
 #include <vector>
 
-namespace FSUIPC {
-
-enum class Error : int {
-  OK = 0,
-  OPEN = 1,
-  NOFS = 2,
-  REGMSG = 3,
-  ATOM = 4,
-  MAP = 5,
-  VIEW = 6,
-  VERSION = 7,
-  WRONGFS = 8,
-  NOTOPEN = 9,
-  NODATA = 10,
-  TIMEOUT = 11,
-  SENDMSG = 12,
-  DATA = 13,
-  RUNNING = 14,
-  SIZE = 15,
-  NOPERMISSION = 16  // Operation not permitted DWORD error code 0x5
-};
+#include "Error.h"
+#include "IOThread.h"
+#include "Platform.h"
+#include "RetryPolicy.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "Transport.h"
 
-static const char* ErrorToString(const Error error) {
-  switch (error) {
-    case Error::OK:
-      return "Okay";
-    case Error::OPEN:
-      return "Attempt to Open when already open";
-    case Error::NOFS:
-      return "Cannot link to FSUIPC or WideClient";
-    case Error::REGMSG:
-      return "Failed to register common message with Windows";
-    case Error::ATOM:
-      return "Failed to create Atom for mapping filename";
-    case Error::MAP:
-      return "Failed to create a file mapping object";
-    case Error::VIEW:
-      return "Failed to open a view to the file map";
-    case Error::VERSION:
-      return "Incorrect version of FSUIPC, or not FSUIPC";
-    case Error::WRONGFS:
-      return "Sim is not version requested";
-    case Error::NOTOPEN:
-      return "Call cannot execute, link not open";
-    case Error::NODATA:
-      return "Call cannot execute: no requests accumulated";
-    case Error::TIMEOUT:
-      return "IPC timed out all retries";
-    case Error::SENDMSG:
-      return "IPC SendMessage failed all retries";
-    case Error::DATA:
-      return "IPC request contains bad data";
-    case Error::RUNNING:
-      return "Maybe running on WideClient, but FS not running on server, or "
-             "wrong FSUIPC";
-    case Error::SIZE:
-      return "Read or Write request cannot be added, memory for process is "
-             "full";
-    case Error::NOPERMISSION:  // Operation not permitted
-      return "Connection denied by the connecting party: please run this "
-             "application as admin";
-  }
-
-  return "";
-}
+namespace FSUIPC {
 
 enum class Simulator : int {
   ANY = 0,
@@ -91,12 +34,50 @@ enum class Simulator : int {
 
 class IPCUser {
  public:
-  ~IPCUser() { this->Close(); }
+  // Uses the platform's default transport
+  IPCUser();
+  // Takes ownership of the transport
+  explicit IPCUser(Transport* transport) : transport(transport) {}
+  ~IPCUser() {
+    this->Close();
+    delete this->transport;
+  }
 
   bool Open(Simulator requestedVersion, Error* result);
   void Close();
   bool Write(DWORD offset, DWORD size, void* src, Error* result);
   bool Process(Error* result);
+  // Drops the requests accumulated since the last Process()
+  void Discard();
+  // Appends pre-serialized requests, whose replies are left in the view
+  bool Load(const BYTE* requests, DWORD size, Error* result);
+
+  // Requests are encoded into one of the transport's views, the first one
+  // until another is selected. Each view keeps its own requests.
+  unsigned Views() const { return this->transport->Views(); }
+  void Select(unsigned view) { this->selected = view; }
+
+  // Processes the selected view on a thread of this IPCUser, so requests can
+  // be encoded into another view and replies of a third one decoded in the
+  // meantime. Wait() must be called before the next ProcessAsync() and
+  // before the view is used again.
+  void ProcessAsync();
+  bool Wait(Error* result);
+
+  // The request frame and, after Process(), the replies of a view
+  const BYTE* View() const { return this->View(this->selected); }
+  const BYTE* View(unsigned view) const {
+    return view < this->frames.size() ? this->frames[view].viewPointer
+                                      : nullptr;
+  }
+  // Bytes of requests accumulated since the last Process()
+  DWORD Used() const {
+    if (this->frames.empty()) {
+      return 0;
+    }
+    const Frame& frame = this->frames[this->selected];
+    return (DWORD)(frame.nextPointer - frame.viewPointer);
+  }
 
   bool Read(DWORD offset, DWORD size, void* dest, Error* result) {
     return this->ReadCommon(false, offset, size, dest, result);
@@ -105,21 +86,50 @@ class IPCUser {
     return this->ReadCommon(true, offset, size, dest, result);
   }
 
+  Transport* GetTransport() const { return this->transport; }
+
+  // Records the timing and retries of each Process() into stats, which must
+  // outlive this IPCUser
+  void SetStats(Stats* stats) { this->stats = stats; }
+  // Records spans of each Process() into tracer, which must outlive this
+  // IPCUser
+  void SetTracer(Tracer* tracer) { this->tracer = tracer; }
+  Tracer* GetTracer() const { return this->tracer; }
+
+  // Bounds the retries of each Process() and the version probes of Open()
+  void SetRetryPolicy(const RetryPolicy& policy) { this->policy = policy; }
+  const RetryPolicy& GetRetryPolicy() const { return this->policy; }
+
  protected:
   DWORD Version;
   DWORD FSVersion;
   DWORD LibVersion = 2002;
 
-  HWND windowHandle;  // FS6 window handle
-  UINT msgId;         // Id of registered window message
-  ATOM atom;          // Atom containing name of file-mapping object
-  HANDLE mapHandle;   // Handle of file-mapping object
-  BYTE* viewPointer;  // Pointer to view of file-mapping object
-  BYTE* nextPointer;
-
-  std::vector<void*> destinations;
+  // The requests accumulated in one of the transport's views
+  struct Frame {
+    BYTE* viewPointer = nullptr;  // Pointer to the transport's view
+    BYTE* nextPointer = nullptr;
+    std::vector<void*> destinations;
+  };
+
+  Transport* transport;
+  std::vector<Frame> frames;  // One per view while open
+  unsigned selected = 0;
+
+  Stats* stats = nullptr;
+  Tracer* tracer = nullptr;
+  RetryPolicy policy;
+
+  // Runs ProcessAsync(), started on first use
+  IOThread sender;
+  std::mutex sendMutex;
+  std::condition_variable sendDone;
+  bool sending = false;
+  bool sendOk = false;
+  Error sendResult = Error::OK;
 
  private:
+  bool Process(unsigned view, Error* result);
   bool ReadCommon(bool special,
                   DWORD offset,
                   DWORD size,
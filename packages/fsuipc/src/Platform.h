@@ -0,0 +1,28 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// Win32 types used by the IPC layer. On other platforms these are aliased so
+// that the protocol code and the shared-memory emulator can be built and
+// benchmarked without a sim.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+typedef uint32_t DWORD;
+typedef uint8_t BYTE;
+typedef unsigned int UINT;
+
+#define CopyMemory(dest, src, len) std::memcpy((dest), (src), (len))
+#define ZeroMemory(dest, len) std::memset((dest), 0, (len))
+
+inline void Sleep(DWORD ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+#endif
+
+#endif
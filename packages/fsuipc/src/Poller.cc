@@ -0,0 +1,62 @@
+#include "Poller.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace FSUIPC {
+
+void Poller::Start(std::chrono::microseconds interval,
+                   std::function<void()> tick) {
+  this->Stop();
+
+  this->stopping = false;
+  this->thread = std::thread(&Poller::Run, this, interval, tick);
+}
+
+void Poller::Stop() {
+  if (!this->thread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->stopping = true;
+  }
+  this->cv.notify_all();
+
+  this->thread.join();
+}
+
+void Poller::Run(std::chrono::microseconds interval,
+                 std::function<void()> tick) {
+#ifdef _WIN32
+  // The default timer resolution of 15.6ms is too coarse for 60 Hz polling
+  timeBeginPeriod(1);
+#endif
+
+  auto next = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (!this->stopping) {
+    lock.unlock();
+    tick();
+    lock.lock();
+
+    // Ticks that were missed are skipped, the next one runs at the first
+    // deadline still ahead
+    next += interval;
+    auto now = std::chrono::steady_clock::now();
+    if (next < now) {
+      next += ((now - next) / interval + 1) * interval;
+    }
+
+    this->cv.wait_until(lock, next, [this] { return this->stopping; });
+  }
+
+#ifdef _WIN32
+  timeEndPeriod(1);
+#endif
+}
+
+}  // namespace FSUIPC
@@ -0,0 +1,38 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace FSUIPC {
+
+// Calls tick on a dedicated thread at a fixed cadence. Ticks are scheduled
+// against absolute deadlines so they don't drift, and ticks that were missed
+// because a previous one overran are skipped rather than run back to back,
+// so the cadence stays on the same grid. Stop() joins the thread, so it is
+// called off the main thread when a tick may wait for a hung sim.
+class Poller {
+ public:
+  ~Poller() { this->Stop(); }
+
+  void Start(std::chrono::microseconds interval, std::function<void()> tick);
+  // Waits for a running tick to finish
+  void Stop();
+
+  bool Running() const { return this->thread.joinable(); }
+
+ private:
+  void Run(std::chrono::microseconds interval, std::function<void()> tick);
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping = false;
+};
+
+}  // namespace FSUIPC
+
+#endif
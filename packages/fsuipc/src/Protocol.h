@@ -0,0 +1,47 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstdint>
+
+#include "Platform.h"
+
+#define MSGNAME "FsasmLib:IPC"
+
+#define MAX_SIZE \
+  0x7F00  // Largest data (kept below 32k to avoid any possible 16-bit sign
+          // problems)
+
+#define FS6IPC_MESSAGE_SUCCESS 1
+#define FS6IPC_MESSAGE_FAILURE 0
+
+// IPC message types
+#define F64IPC_READSTATEDATA_ID 1
+#define FS6IPC_WRITESTATEDATA_ID 2
+
+// pDest of requests whose replies are copied out of the view by the caller
+#define PDEST_NONE 0xFFFFFFFF
+
+#pragma pack(push, r1, 1)
+// read request structure
+typedef struct tagF64IPC_READSTATEDATA_HDR {
+  DWORD dwId;      // F64IPC_READSTATEDATA_ID
+  DWORD dwOffset;  // state table offset
+  DWORD nBytes;    // number of bytes of state data to read
+  uint32_t pDest;  // destination buffer for data (client use only)
+} F64IPC_READSTATEDATA_HDR;
+
+// write request structure
+typedef struct tagFS6IPC_WRITESTATEDATA_HDR {
+  DWORD dwId;      // FS6IPC_WRITESTATEDATA_ID
+  DWORD dwOffset;  // state table offset
+  DWORD nBytes;    // number of bytes of state data to write
+} FS6IPC_WRITESTATEDATA_HDR;
+
+#pragma pack(pop, r1)
+
+// Largest payload of a single request, leaving room for its header and the
+// terminator of the transaction. IPCUser checks requests against these.
+#define MAX_READ_SIZE (MAX_SIZE - sizeof(F64IPC_READSTATEDATA_HDR) - 4)
+#define MAX_WRITE_SIZE (MAX_SIZE - sizeof(FS6IPC_WRITESTATEDATA_HDR) - 4)
+
+#endif
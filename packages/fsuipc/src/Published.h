@@ -0,0 +1,29 @@
+#ifndef PUBLISHED_H
+#define PUBLISHED_H
+
+#include <memory>
+
+namespace FSUIPC {
+
+// An immutable value that one thread replaces as a whole while others read
+// it. Neither side waits for the other for longer than a pointer swap, and a
+// reader keeps the version it loaded alive for as long as it holds on to it,
+// so old versions are freed once their last reader is done with them.
+template <typename T>
+class Published {
+ public:
+  std::shared_ptr<const T> Load() const {
+    return std::atomic_load(&this->current);
+  }
+
+  void Store(std::shared_ptr<const T> value) {
+    std::atomic_store(&this->current, std::move(value));
+  }
+
+ private:
+  std::shared_ptr<const T> current;
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,140 @@
+#include "ReadPlan.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "Protocol.h"
+
+namespace FSUIPC {
+
+void ReadPlan::Build(std::vector<ReadTarget> targets, DWORD maxGap) {
+  this->Clear();
+
+  std::sort(targets.begin(), targets.end(),
+            [](const ReadTarget& a, const ReadTarget& b) {
+              return a.offset < b.offset;
+            });
+
+  // Ends are kept in 64 bits, so offsets near the top of the DWORD range
+  // don't wrap around and merge with blocks at the start
+  uint64_t start = 0;
+  uint64_t end = 0;
+  std::vector<size_t> members;
+  std::vector<size_t> scatterBlocks;
+
+  auto flush = [&]() {
+    for (size_t i : members) {
+      this->scatters.push_back(ReadScatter{
+          (size_t)(targets[i].offset - start), targets[i].size,
+          targets[i].dest});
+      scatterBlocks.push_back(this->blocks.size());
+    }
+    this->blocks.push_back(ReadBlock{(DWORD)start, (DWORD)(end - start), 0});
+    members.clear();
+  };
+
+  for (size_t i = 0; i < targets.size(); i++) {
+    const ReadTarget& target = targets[i];
+    uint64_t targetEnd = (uint64_t)target.offset + target.size;
+
+    if (!members.empty()) {
+      uint64_t mergedEnd = std::max(end, targetEnd);
+      if (target.offset > end + maxGap || mergedEnd - start > MAX_READ_SIZE) {
+        flush();
+      } else {
+        end = mergedEnd;
+        members.push_back(i);
+        continue;
+      }
+    }
+
+    start = target.offset;
+    end = targetEnd;
+    members.push_back(i);
+  }
+
+  if (!members.empty()) {
+    flush();
+  }
+
+  // First-fit decreasing, so large strings and byte arrays are placed first
+  // and the small offsets fill the space they leave in each frame
+  std::vector<size_t> order(this->blocks.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return this->blocks[a].size > this->blocks[b].size;
+  });
+
+  std::vector<std::vector<size_t>> frameBlocks;
+  std::vector<size_t> used;
+  for (size_t i : order) {
+    size_t cost = sizeof(F64IPC_READSTATEDATA_HDR) + this->blocks[i].size;
+    size_t frame = 0;
+    while (frame < used.size() && used[frame] + cost > MAX_SIZE) {
+      frame++;
+    }
+    if (frame == used.size()) {
+      used.push_back(0);
+      frameBlocks.push_back(std::vector<size_t>());
+    }
+    used[frame] += cost;
+    frameBlocks[frame].push_back(i);
+  }
+
+  // Serialize each frame, with zeroed reception areas so rubbish won't be
+  // returned. The replies of all frames are kept side by side in the buffer.
+  for (size_t frame = 0; frame < frameBlocks.size(); frame++) {
+    ReadFrame compiled{std::vector<BYTE>(used[frame], 0), this->buffer.size()};
+    size_t position = 0;
+
+    for (size_t i : frameBlocks[frame]) {
+      ReadBlock& block = this->blocks[i];
+      F64IPC_READSTATEDATA_HDR* header =
+          (F64IPC_READSTATEDATA_HDR*)&compiled.request[position];
+
+      header->dwId = F64IPC_READSTATEDATA_ID;
+      header->dwOffset = block.offset;
+      header->nBytes = block.size;
+      header->pDest = PDEST_NONE;
+
+      position += sizeof(F64IPC_READSTATEDATA_HDR);
+      block.buffer = compiled.buffer + position;
+      position += block.size;
+    }
+
+    this->buffer.resize(compiled.buffer + compiled.request.size());
+    this->frames.push_back(std::move(compiled));
+  }
+
+  for (size_t i = 0; i < this->scatters.size(); i++) {
+    this->scatters[i].buffer += this->blocks[scatterBlocks[i]].buffer;
+  }
+}
+
+void ReadPlan::Clear() {
+  this->blocks.clear();
+  this->frames.clear();
+  this->scatters.clear();
+  this->buffer.clear();
+}
+
+bool ReadPlan::Read(IPCUser* ipc, size_t frame, Error* result) {
+  const std::vector<BYTE>& request = this->frames[frame].request;
+  return ipc->Load(request.data(), request.size(), result);
+}
+
+void ReadPlan::Receive(const BYTE* view, size_t frame, DWORD position) {
+  const ReadFrame& compiled = this->frames[frame];
+  CopyMemory(&this->buffer[compiled.buffer], view + position,
+             compiled.request.size());
+}
+
+void ReadPlan::Scatter() const {
+  for (const ReadScatter& scatter : this->scatters) {
+    CopyMemory(scatter.dest, &this->buffer[scatter.buffer], scatter.size);
+  }
+}
+
+}  // namespace FSUIPC
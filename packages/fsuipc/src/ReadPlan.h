@@ -0,0 +1,75 @@
+#ifndef READPLAN_H
+#define READPLAN_H
+
+#include <vector>
+
+#include "IPCUser.h"
+#include "Platform.h"
+
+namespace FSUIPC {
+
+// A single offset that should be read into dest
+struct ReadTarget {
+  DWORD offset;
+  DWORD size;
+  void* dest;
+};
+
+// A contiguous range of the offset table read with a single request
+struct ReadBlock {
+  DWORD offset;
+  DWORD size;
+  size_t buffer;  // Position of the block's data in the plan's buffer
+};
+
+// Where a target's bytes are found in the plan's buffer
+struct ReadScatter {
+  size_t buffer;
+  DWORD size;
+  void* dest;
+};
+
+// A serialized request frame, loaded into the IPC view as-is every cycle
+struct ReadFrame {
+  std::vector<BYTE> request;
+  size_t buffer;  // Position of the frame's reply in the plan's buffer
+};
+
+// Plans the read requests for a set of offsets. Offsets are sorted by address
+// and runs that overlap or are separated by at most maxGap bytes are merged
+// into a single block, so aliases and neighbouring offsets cost one request
+// header instead of one each.
+//
+// Blocks that do not fit in a single request frame are spread over multiple
+// frames, largest first, so each frame is filled as fully as possible. The
+// frames are serialized once by Build(), so a cycle only has to copy them
+// into the view and copy the replies back out.
+class ReadPlan {
+ public:
+  void Build(std::vector<ReadTarget> targets, DWORD maxGap);
+  void Clear();
+
+  // Loads the frame's read requests into the view
+  bool Read(IPCUser* ipc, size_t frame, Error* result);
+  // Copies the frame's replies out of the IPC view after it has been
+  // processed, position is where the frame was loaded into the view
+  void Receive(const BYTE* view, size_t frame, DWORD position);
+  // Copies the data of each block back into the targets' destinations
+  void Scatter() const;
+
+  const std::vector<ReadBlock>& Blocks() const { return this->blocks; }
+  size_t Frames() const { return this->frames.size(); }
+  size_t FrameSize(size_t frame) const {
+    return this->frames[frame].request.size();
+  }
+
+ protected:
+  std::vector<ReadBlock> blocks;
+  std::vector<ReadFrame> frames;
+  std::vector<ReadScatter> scatters;
+  std::vector<BYTE> buffer;
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,103 @@
+#include "Registry.h"
+
+namespace FSUIPC {
+
+// Destinations are 8 byte aligned, so every value can be read in place
+#define SLOT_ALIGN 8
+#define NO_INDEX ((size_t)-1)
+
+static size_t SlotSize(DWORD size) {
+  return (size + SLOT_ALIGN - 1) & ~(size_t)(SLOT_ALIGN - 1);
+}
+
+Handle Registry::Add(const std::string& name,
+                     Type type,
+                     DWORD offset,
+                     DWORD size,
+                     const std::string& group) {
+  auto existing = this->names.find(name);
+  if (existing != this->names.end()) {
+    this->Remove(existing->second, nullptr);
+  }
+
+  Handle handle;
+  if (!this->released.empty()) {
+    handle = this->released.back();
+    this->released.pop_back();
+  } else {
+    handle = (Handle)this->indices.size();
+    this->indices.push_back(NO_INDEX);
+  }
+
+  size_t slot = this->slab.size();
+  this->slab.resize(slot + SlotSize(size), 0);
+
+  this->indices[handle] = this->offsets.size();
+  this->offsets.push_back(
+      Offset{handle, name, type, offset, size, slot, group});
+  this->names[name] = handle;
+  this->generation++;
+
+  return handle;
+}
+
+bool Registry::Remove(Handle handle, Offset* removed) {
+  if (handle >= this->indices.size() || this->indices[handle] == NO_INDEX) {
+    return false;
+  }
+
+  size_t index = this->indices[handle];
+  Offset offset = this->offsets[index];
+  size_t slotSize = SlotSize(offset.size);
+
+  // Compact the slab and shift the offsets after the removed one
+  this->slab.erase(this->slab.begin() + offset.slot,
+                   this->slab.begin() + offset.slot + slotSize);
+  this->offsets.erase(this->offsets.begin() + index);
+  for (size_t i = index; i < this->offsets.size(); i++) {
+    this->offsets[i].slot -= slotSize;
+    this->indices[this->offsets[i].handle] = i;
+  }
+
+  this->indices[handle] = NO_INDEX;
+  this->released.push_back(handle);
+  this->names.erase(offset.name);
+  this->generation++;
+
+  if (removed) {
+    *removed = offset;
+  }
+  return true;
+}
+
+const Offset* Registry::Find(Handle handle) const {
+  if (handle >= this->indices.size() || this->indices[handle] == NO_INDEX) {
+    return nullptr;
+  }
+  return &this->offsets[this->indices[handle]];
+}
+
+const Offset* Registry::Find(const std::string& name) const {
+  auto it = this->names.find(name);
+  if (it == this->names.end()) {
+    return nullptr;
+  }
+  return this->Find(it->second);
+}
+
+std::vector<ReadTarget> Registry::Targets(const std::string& group) {
+  std::vector<ReadTarget> targets;
+
+  for (const Offset& offset : this->offsets) {
+    if (offset.group != group) {
+      continue;
+    }
+
+    targets.push_back(
+        ReadTarget{offset.offset, offset.size, &this->slab[offset.slot]});
+  }
+
+  return targets;
+}
+
+}  // namespace FSUIPC
@@ -0,0 +1,72 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Platform.h"
+#include "ReadPlan.h"
+#include "Type.h"
+
+namespace FSUIPC {
+
+typedef uint32_t Handle;
+
+struct Offset {
+  Handle handle;
+  std::string name;
+  Type type;
+  DWORD offset;
+  DWORD size;
+  size_t slot;        // Position of the offset's destination in the slab
+  std::string group;  // Name of the offset's group, see Scheduler
+};
+
+// Keeps the registered offsets in insertion order, with the destinations of
+// all offsets in one contiguous slab. Each offset is identified by a small
+// integer handle, which stays valid until the offset is removed. Removing an
+// offset compacts the slab, so it is always as large as the offsets need.
+class Registry {
+ public:
+  // Replaces any offset previously registered under the same name
+  Handle Add(const std::string& name,
+             Type type,
+             DWORD offset,
+             DWORD size,
+             const std::string& group = "");
+  bool Remove(Handle handle, Offset* removed);
+
+  const Offset* Find(Handle handle) const;
+  const Offset* Find(const std::string& name) const;
+
+  const std::vector<Offset>& Offsets() const { return this->offsets; }
+  size_t Size() const { return this->offsets.size(); }
+
+  BYTE* Data(const Offset& offset) { return &this->slab[offset.slot]; }
+  const BYTE* Data(const Offset& offset) const {
+    return &this->slab[offset.slot];
+  }
+  const std::vector<BYTE>& Slab() const { return this->slab; }
+
+  // Changes whenever offsets are added or removed
+  uint64_t Generation() const { return this->generation; }
+
+  // The reads that fill the slab for the offsets of a group, invalidated by
+  // Add() and Remove()
+  std::vector<ReadTarget> Targets(const std::string& group = "");
+
+ protected:
+  std::vector<Offset> offsets;
+  std::vector<BYTE> slab;
+  uint64_t generation = 0;
+
+  std::unordered_map<std::string, Handle> names;
+  std::vector<size_t> indices;   // Index into offsets of each handle
+  std::vector<Handle> released;  // Handles that can be reused
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,64 @@
+#include "RetryPolicy.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace FSUIPC {
+
+// Cancellation is noticed within this time while waiting
+static const std::chrono::milliseconds CANCEL_POLL(10);
+
+Error RetryPolicy::Check() const {
+  if (this->cancelled && this->cancelled->load()) {
+    return Error::CANCELLED;
+  }
+  if (Clock::now() >= this->deadline) {
+    return Error::DEADLINE;
+  }
+  return Error::OK;
+}
+
+std::chrono::milliseconds RetryPolicy::AttemptTimeout() const {
+  if (this->deadline == Clock::time_point::max()) {
+    return this->attemptTimeout;
+  }
+
+  auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      this->deadline - Clock::now());
+  return std::max(std::chrono::milliseconds(1),
+                  std::min(this->attemptTimeout, left));
+}
+
+bool RetryPolicy::Backoff(unsigned attempt, Error* result) const {
+  std::chrono::milliseconds delay = this->backoff;
+  for (unsigned i = 0; i < attempt && delay < this->maxBackoff; i++) {
+    delay *= 2;
+  }
+  delay = std::min(delay, this->maxBackoff);
+
+  Clock::time_point until = Clock::now() + delay;
+  if (until >= this->deadline) {
+    *result = Error::DEADLINE;
+    return false;
+  }
+
+  return this->Wait(delay, result);
+}
+
+bool RetryPolicy::Wait(Clock::duration delay, Error* result) const {
+  Clock::time_point until = Clock::now() + delay;
+  for (Clock::time_point now = Clock::now(); now < until;
+       now = Clock::now()) {
+    *result = this->Check();
+    if (*result != Error::OK) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::min<Clock::duration>(until - now,
+                                                          CANCEL_POLL));
+  }
+
+  *result = this->Check();
+  return *result == Error::OK;
+}
+
+}  // namespace FSUIPC
@@ -0,0 +1,40 @@
+#ifndef RETRYPOLICY_H
+#define RETRYPOLICY_H
+
+#include <atomic>
+#include <chrono>
+
+#include "Error.h"
+
+namespace FSUIPC {
+
+// Bounds the time spent getting a request to the sim. Each attempt waits at
+// most attemptTimeout for an answer, and failed attempts are retried after a
+// backoff that doubles up to maxBackoff, until all attempts have been made,
+// the deadline has passed or the request is cancelled.
+struct RetryPolicy {
+  typedef std::chrono::steady_clock Clock;
+
+  std::chrono::milliseconds attemptTimeout{2000};
+  unsigned attempts = 9;
+  std::chrono::milliseconds backoff{100};
+  std::chrono::milliseconds maxBackoff{1600};
+  Clock::time_point deadline = Clock::time_point::max();
+  // Set from another thread to give up at the next check, may be null
+  const std::atomic<bool>* cancelled = nullptr;
+
+  // CANCELLED or DEADLINE if the request should be given up, OK otherwise
+  Error Check() const;
+  // The attempt timeout, shortened to the time left until the deadline
+  std::chrono::milliseconds AttemptTimeout() const;
+  // Waits before retrying a failed attempt. Returns false without waiting if
+  // the deadline would pass first, or as soon as the request is cancelled.
+  bool Backoff(unsigned attempt, Error* result) const;
+  // Sleeps for delay, returning false as soon as the request is cancelled or
+  // the deadline passes
+  bool Wait(Clock::duration delay, Error* result) const;
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,54 @@
+#include "Scheduler.h"
+
+namespace FSUIPC {
+
+void Scheduler::SetInterval(const std::string& group,
+                            std::chrono::microseconds interval) {
+  Group& entry = this->groups[group];
+  entry.interval = interval;
+  entry.due = Clock::time_point();
+}
+
+void Scheduler::Build(Registry& registry, DWORD maxGap) {
+  for (auto& it : this->groups) {
+    it.second.plan.Clear();
+  }
+
+  for (const Offset& offset : registry.Offsets()) {
+    this->groups[offset.group];
+  }
+
+  for (auto& it : this->groups) {
+    it.second.plan.Build(registry.Targets(it.first), maxGap);
+  }
+}
+
+void Scheduler::Select(Clock::time_point now, std::vector<ReadPlan*>* plans) {
+  for (auto& it : this->groups) {
+    Group& group = it.second;
+
+    group.selected = group.plan.Frames() > 0 && now >= group.due;
+    if (group.selected) {
+      plans->push_back(&group.plan);
+    }
+  }
+}
+
+void Scheduler::Commit(Clock::time_point now) {
+  for (auto& it : this->groups) {
+    Group& group = it.second;
+
+    if (group.selected) {
+      group.due = now + group.interval;
+      group.selected = false;
+    }
+  }
+}
+
+void Scheduler::Expire() {
+  for (auto& it : this->groups) {
+    it.second.due = Clock::time_point();
+  }
+}
+
+}  // namespace FSUIPC
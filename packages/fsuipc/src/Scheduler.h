@@ -0,0 +1,51 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ReadPlan.h"
+#include "Registry.h"
+
+namespace FSUIPC {
+
+// Offsets are read in groups, each with its own interval. Every cycle only
+// reads the groups that are due, and a group never causes a cycle of its own:
+// it is read by the first cycle after its interval has passed, sharing that
+// cycle's transactions with the groups that are read more often.
+//
+// The default group "" has an interval of 0 and is read every cycle, as are
+// groups that offsets refer to before an interval was set for them.
+class Scheduler {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  void SetInterval(const std::string& group,
+                   std::chrono::microseconds interval);
+
+  // Rebuilds the read plan of every group from the registry
+  void Build(Registry& registry, DWORD maxGap);
+
+  // Appends the plans of the groups that are due at now
+  void Select(Clock::time_point now, std::vector<ReadPlan*>* plans);
+  // Marks the selected groups as read at now, after the cycle succeeded
+  void Commit(Clock::time_point now);
+  // Makes every group due, so the next cycle reads all offsets
+  void Expire();
+
+ protected:
+  struct Group {
+    std::chrono::microseconds interval{0};
+    Clock::time_point due;
+    bool selected = false;
+    ReadPlan plan;
+  };
+
+  std::map<std::string, Group> groups;
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,197 @@
+#include "ShmTransport.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+
+#include "Protocol.h"
+
+namespace FSUIPC {
+
+static BYTE* MapSegment(const std::string& name, size_t size) {
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (ptr == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+
+  return (BYTE*)ptr;
+}
+
+bool ShmTransport::Open(Error* result) {
+  char szName[64];
+  static int nTry = 0;
+
+  nTry++;  // Ensures a unique name is used in case user closes and reopens
+
+  snprintf(szName, sizeof szName, "/fsuipc-table-%X-%X", (unsigned)getpid(),
+           nTry);
+  this->tableName = szName;
+  this->tablePointer = MapSegment(this->tableName, SHM_TABLE_SIZE);
+  if (this->tablePointer == nullptr) {
+    *result = Error::MAP;
+    this->Close();
+    return false;
+  }
+
+  this->segments.resize(this->views);
+  for (unsigned view = 0; view < this->views; view++) {
+    Segment& segment = this->segments[view];
+
+    snprintf(szName, sizeof szName, "/fsuipc-ipc-%X-%X-%u",
+             (unsigned)getpid(), nTry, view);
+    segment.name = szName;
+    segment.pointer = MapSegment(segment.name, MAX_SIZE + 256);
+    if (segment.pointer == nullptr) {
+      *result = Error::VIEW;
+      this->Close();
+      return false;
+    }
+  }
+
+  // FSUIPC version 7.0, and the 0xFADE check pattern with MSFS as the sim
+  DWORD version = 0x70000000;
+  DWORD fsVersion = 0xFADE000D;
+  CopyMemory(&this->tablePointer[0x3304], &version, 4);
+  CopyMemory(&this->tablePointer[0x3308], &fsVersion, 4);
+
+  *result = Error::OK;
+  return true;
+}
+
+void ShmTransport::Close() {
+  for (Segment& segment : this->segments) {
+    if (segment.pointer) {
+      munmap(segment.pointer, MAX_SIZE + 256);
+      shm_unlink(segment.name.c_str());
+    }
+  }
+  this->segments.clear();
+
+  if (this->tablePointer) {
+    munmap(this->tablePointer, SHM_TABLE_SIZE);
+    shm_unlink(this->tableName.c_str());
+    this->tablePointer = nullptr;
+  }
+}
+
+bool ShmTransport::Send(unsigned view,
+                        const RetryPolicy& policy,
+                        Error* result) {
+  if (view >= this->segments.size()) {
+    *result = Error::NOTOPEN;
+    return false;
+  }
+
+  std::chrono::microseconds latency(this->latencyMicros);
+  this->retries = 0;
+
+  for (unsigned attempt = 0;; attempt++) {
+    *result = policy.Check();
+    if (*result != Error::OK) {
+      return false;
+    }
+
+    std::chrono::microseconds timeout = policy.AttemptTimeout();
+    // Waits like a sim that is slow to answer, which is given up on as soon
+    // as the request is cancelled
+    if (latency <= timeout) {
+      if (!policy.Wait(latency, result)) {
+        return false;
+      }
+      break;
+    }
+
+    // The emulated sim doesn't answer within the attempt timeout
+    if (!policy.Wait(timeout, result)) {
+      return false;
+    }
+    if (attempt + 1 >= policy.attempts) {
+      *result = Error::TIMEOUT;
+      return false;
+    }
+
+    this->retries++;
+    if (!policy.Backoff(attempt, result)) {
+      return false;
+    }
+  }
+
+  if (!this->Serve(this->segments[view].pointer)) {
+    *result = Error::DATA;  // The emulated sim didn't like the data
+    return false;
+  }
+
+  *result = Error::OK;
+  return true;
+}
+
+// Whether a request for size bytes at offset fits in the table, with its
+// payload between pointer and end. Compared without adding to offset or
+// pointer, which would wrap for sizes a request can ask for.
+static bool RequestFits(const BYTE* pointer,
+                        const BYTE* end,
+                        DWORD offset,
+                        DWORD size) {
+  return pointer <= end && size <= (size_t)(end - pointer) &&
+         size <= SHM_TABLE_SIZE && offset <= SHM_TABLE_SIZE - size;
+}
+
+bool ShmTransport::Serve(BYTE* view) {
+  BYTE* pointer = view;
+  BYTE* end = view + MAX_SIZE;
+
+  while (pointer + 4 <= end && *(DWORD*)pointer) {
+    switch (*(DWORD*)pointer) {
+      case F64IPC_READSTATEDATA_ID: {
+        F64IPC_READSTATEDATA_HDR* header = (F64IPC_READSTATEDATA_HDR*)pointer;
+        pointer += sizeof(F64IPC_READSTATEDATA_HDR);
+        if (!RequestFits(pointer, end, header->dwOffset, header->nBytes)) {
+          return false;
+        }
+        CopyMemory(pointer, &this->tablePointer[header->dwOffset],
+                   header->nBytes);
+        pointer += header->nBytes;
+        break;
+      }
+      case FS6IPC_WRITESTATEDATA_ID: {
+        FS6IPC_WRITESTATEDATA_HDR* header =
+            (FS6IPC_WRITESTATEDATA_HDR*)pointer;
+        pointer += sizeof(FS6IPC_WRITESTATEDATA_HDR);
+        if (!RequestFits(pointer, end, header->dwOffset, header->nBytes)) {
+          return false;
+        }
+        // 0x330A only records the library version, the FS version and check
+        // pattern at 0x3308 stay read-only
+        if (header->dwOffset != 0x330a) {
+          CopyMemory(&this->tablePointer[header->dwOffset], pointer,
+                     header->nBytes);
+        }
+        pointer += header->nBytes;
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace FSUIPC
@@ -0,0 +1,58 @@
+#ifndef SHMTRANSPORT_H
+#define SHMTRANSPORT_H
+
+#include <string>
+#include <vector>
+
+#include "Transport.h"
+
+namespace FSUIPC {
+
+#define SHM_TABLE_SIZE 0x10000
+
+// Emulates FSUIPC on POSIX systems. The request buffers and a fake 64K offset
+// table live in POSIX shared-memory segments, and Send() serves the read and
+// write requests in a buffer against the table exactly like FSUIPC does, so
+// the encoder and decoder can be exercised without a sim.
+class ShmTransport : public Transport {
+ public:
+  // latencyMicros simulates the time the sim takes to answer each request,
+  // requests time out when it is longer than the attempt timeout
+  explicit ShmTransport(unsigned int latencyMicros = 0, unsigned views = 2)
+      : latencyMicros(latencyMicros), views(views) {}
+  ~ShmTransport() { this->Close(); }
+
+  bool Open(Error* result) override;
+  void Close() override;
+  bool Send(unsigned view, const RetryPolicy& policy, Error* result) override;
+
+  unsigned Views() const override { return this->views; }
+  BYTE* View(unsigned view) const override {
+    return this->segments[view].pointer;
+  }
+  unsigned Retries() const override { return this->retries; }
+
+  // The emulated offset table, valid while the transport is open
+  BYTE* Table() const { return this->tablePointer; }
+
+ protected:
+  struct Segment {
+    std::string name;
+    BYTE* pointer = nullptr;
+  };
+
+  unsigned int latencyMicros;
+  unsigned views;
+
+  std::vector<Segment> segments;
+  std::string tableName;
+  BYTE* tablePointer = nullptr;
+  unsigned retries = 0;
+
+ private:
+  bool Serve(BYTE* view);
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,111 @@
+#include "Stats.h"
+
+#include <algorithm>
+
+namespace FSUIPC {
+
+int Histogram::BucketOf(uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return (int)value;
+  }
+
+  int msb = 63;
+  while (!(value >> msb)) {
+    msb--;
+  }
+
+  // Values with their highest bit at msb share the buckets of that power of
+  // two, by the 4 bits below it
+  int shift = msb - 4;
+  return (shift + 1) * SUB_BUCKETS +
+         (int)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::ValueOf(int bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+
+  int shift = bucket / SUB_BUCKETS - 1;
+  uint64_t sub = bucket % SUB_BUCKETS;
+  return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void Histogram::Record(uint64_t value) {
+  this->counts[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  this->count.fetch_add(1, std::memory_order_relaxed);
+  this->sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t max = this->max.load(std::memory_order_relaxed);
+  while (value > max && !this->max.compare_exchange_weak(
+                            max, value, std::memory_order_relaxed)) {
+  }
+}
+
+void Histogram::Reset() {
+  for (std::atomic<uint64_t>& bucket : this->counts) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  this->count.store(0, std::memory_order_relaxed);
+  this->sum.store(0, std::memory_order_relaxed);
+  this->max.store(0, std::memory_order_relaxed);
+}
+
+Histogram::Summary Histogram::Summarize() const {
+  Summary summary = {};
+
+  // Counted from the buckets, so the percentiles agree with each other even
+  // when values are recorded concurrently
+  uint64_t counts[BUCKETS];
+  for (int i = 0; i < BUCKETS; i++) {
+    counts[i] = this->counts[i].load(std::memory_order_relaxed);
+    summary.count += counts[i];
+  }
+
+  if (summary.count == 0) {
+    return summary;
+  }
+
+  summary.mean =
+      (double)this->sum.load(std::memory_order_relaxed) / summary.count;
+  summary.max = this->max.load(std::memory_order_relaxed);
+
+  const double quantiles[] = {0.5, 0.9, 0.99};
+  uint64_t* values[] = {&summary.p50, &summary.p90, &summary.p99};
+
+  uint64_t seen = 0;
+  int q = 0;
+  for (int i = 0; i < BUCKETS && q < 3; i++) {
+    seen += counts[i];
+    while (q < 3 && seen >= quantiles[q] * summary.count) {
+      // Never report more than was recorded
+      *values[q] = std::min(ValueOf(i), summary.max);
+      q++;
+    }
+  }
+
+  return summary;
+}
+
+void Stats::Reset() {
+  this->queue.Reset();
+  this->lock.Reset();
+  this->cycle.Reset();
+  this->send.Reset();
+  this->convert.Reset();
+  this->total.Reset();
+
+  this->cycles = 0;
+  this->coalesced = 0;
+  this->transactions = 0;
+  this->retries = 0;
+  this->bytesRead = 0;
+  this->bytesWritten = 0;
+  this->errors = 0;
+  this->sizeErrors = 0;
+  this->timeoutErrors = 0;
+  this->deadlineErrors = 0;
+  this->reconnects = 0;
+}
+
+}  // namespace FSUIPC
@@ -0,0 +1,79 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace FSUIPC {
+
+// Histogram of durations in nanoseconds. Like HdrHistogram, each power of two
+// is split into 16 linear buckets, so every recorded value is within 1/16 of
+// the value it is reported as. Record() is lock-free and can be called from
+// any thread.
+class Histogram {
+ public:
+  struct Summary {
+    uint64_t count;
+    double mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+  };
+
+  void Record(uint64_t value);
+  void Record(std::chrono::steady_clock::duration duration) {
+    this->Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     duration)
+                     .count());
+  }
+
+  // Values recorded while resetting may be partially counted
+  void Reset();
+
+  Summary Summarize() const;
+
+ protected:
+  static const int SUB_BUCKETS = 16;
+  static const int BUCKETS = 64 * SUB_BUCKETS;
+
+  static int BucketOf(uint64_t value);
+  // The highest value that is counted in the bucket
+  static uint64_t ValueOf(int bucket);
+
+  std::atomic<uint64_t> counts[BUCKETS] = {};
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> sum{0};
+  std::atomic<uint64_t> max{0};
+};
+
+// Counters and phase timings of the cycles of a connection
+struct Stats {
+  Histogram queue;    // From process() until a worker thread picks it up
+  Histogram lock;     // Waiting for the offsets and the connection
+  Histogram cycle;    // All transactions of a cycle
+  Histogram send;     // A single transaction, including retries
+  Histogram convert;  // Building the result on the main thread
+  Histogram total;    // From process() until its promise is settled
+
+  std::atomic<uint64_t> cycles{0};
+  // Calls that shared a cycle queued by an earlier call
+  std::atomic<uint64_t> coalesced{0};
+  std::atomic<uint64_t> transactions{0};
+  std::atomic<uint64_t> retries{0};
+  std::atomic<uint64_t> bytesRead{0};
+  std::atomic<uint64_t> bytesWritten{0};
+  std::atomic<uint64_t> errors{0};
+  std::atomic<uint64_t> sizeErrors{0};
+  std::atomic<uint64_t> timeoutErrors{0};
+  std::atomic<uint64_t> deadlineErrors{0};
+  // Times the link was restored after it was lost
+  std::atomic<uint64_t> reconnects{0};
+
+  void Reset();
+};
+
+}  // namespace FSUIPC
+
+#endif
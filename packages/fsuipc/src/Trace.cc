@@ -0,0 +1,77 @@
+#include "Trace.h"
+
+#include <cstdio>
+
+namespace FSUIPC {
+
+// Small sequential ids, which are easier to tell apart in a trace viewer than
+// the ids of the OS
+static uint32_t ThreadId() {
+  static std::atomic<uint32_t> threads{0};
+  thread_local uint32_t id = ++threads;
+  return id;
+}
+
+void Tracer::Start(size_t capacity) {
+  std::lock_guard<std::mutex> guard(this->mutex);
+
+  this->events.assign(capacity, Event{});
+  this->next = 0;
+  this->wrapped = false;
+  this->epoch = Clock::now();
+  this->enabled = capacity > 0;
+}
+
+void Tracer::Stop() {
+  this->enabled = false;
+}
+
+void Tracer::Record(const char* name,
+                    Clock::time_point start,
+                    Clock::time_point end) {
+  uint32_t thread = ThreadId();
+
+  std::lock_guard<std::mutex> guard(this->mutex);
+
+  if (this->events.empty()) {
+    return;
+  }
+
+  this->events[this->next] = Event{name, start, end - start, thread};
+  if (++this->next == this->events.size()) {
+    this->next = 0;
+    this->wrapped = true;
+  }
+}
+
+std::string Tracer::ToJSON() const {
+  std::lock_guard<std::mutex> guard(this->mutex);
+
+  std::string json = "{\"traceEvents\":[";
+  char buffer[256];
+
+  size_t count = this->wrapped ? this->events.size() : this->next;
+  size_t first = this->wrapped ? this->next : 0;
+
+  for (size_t i = 0; i < count; i++) {
+    const Event& event = this->events[(first + i) % this->events.size()];
+
+    // Timestamps are in microseconds since Start()
+    double ts = std::chrono::duration<double, std::micro>(event.start -
+                                                          this->epoch)
+                    .count();
+    double dur =
+        std::chrono::duration<double, std::micro>(event.duration).count();
+
+    snprintf(buffer, sizeof buffer,
+             "%s{\"name\":\"%s\",\"cat\":\"fsuipc\",\"ph\":\"X\",\"ts\":%.3f,"
+             "\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+             i > 0 ? "," : "", event.name, ts, dur, event.thread);
+    json += buffer;
+  }
+
+  json += "],\"displayTimeUnit\":\"ms\"}";
+  return json;
+}
+
+}  // namespace FSUIPC
@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace FSUIPC {
+
+// Records timed spans into a fixed-size ring buffer, overwriting the oldest
+// span when it is full, and exports them in the Chrome trace event format
+// (chrome://tracing, Perfetto). While stopped, a span costs a single atomic
+// load.
+class Tracer {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // Starts recording into an empty buffer of capacity spans
+  void Start(size_t capacity);
+  void Stop();
+  bool Enabled() const { return this->enabled.load(std::memory_order_relaxed); }
+
+  // name must outlive the tracer, usually it is a string literal
+  void Record(const char* name, Clock::time_point start, Clock::time_point end);
+
+  // The recorded spans, oldest first, as a JSON trace
+  std::string ToJSON() const;
+
+ protected:
+  struct Event {
+    const char* name;
+    Clock::time_point start;
+    Clock::duration duration;
+    uint32_t thread;
+  };
+
+  std::atomic<bool> enabled{false};
+
+  mutable std::mutex mutex;
+  std::vector<Event> events;
+  size_t next = 0;
+  bool wrapped = false;
+  Clock::time_point epoch = Clock::now();
+};
+
+// Records the time between its construction and destruction as a span, if
+// the tracer is recording when it is constructed
+class TraceSpan {
+ public:
+  TraceSpan(Tracer* tracer, const char* name)
+      : tracer(tracer && tracer->Enabled() ? tracer : nullptr), name(name) {
+    if (this->tracer) {
+      this->start = Tracer::Clock::now();
+    }
+  }
+
+  ~TraceSpan() {
+    if (this->tracer) {
+      this->tracer->Record(this->name, this->start, Tracer::Clock::now());
+    }
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  Tracer* tracer;
+  const char* name;
+  Tracer::Clock::time_point start;
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "Error.h"
+#include "Platform.h"
+#include "RetryPolicy.h"
+
+namespace FSUIPC {
+
+// A Transport owns the shared request buffers and delivers them to the sim.
+// IPCUser encodes requests into a View(), calls Send() and decodes the
+// replies the sim wrote back into the same buffer.
+//
+// Each view is mapped under its own name, so requests can be encoded into
+// one view while the sim is processing another.
+class Transport {
+ public:
+  virtual ~Transport() {}
+
+  // Connects to the sim and maps Views() views of at least MAX_SIZE + 256
+  // bytes each
+  virtual bool Open(Error* result) = 0;
+  virtual void Close() = 0;
+
+  // Asks the sim to process the request frame currently in the view,
+  // retrying and giving up as the policy says. Only one view is sent at a
+  // time.
+  virtual bool Send(unsigned view,
+                    const RetryPolicy& policy,
+                    Error* result) = 0;
+
+  virtual unsigned Views() const { return 1; }
+  virtual BYTE* View(unsigned view) const = 0;
+
+  // Times the last Send() had to be retried
+  virtual unsigned Retries() const { return 0; }
+
+  // Whether the sim can be connected to, cheap enough to poll
+  virtual bool Available() const { return true; }
+
+  // Whether we are connected through WideClient, which only simulates FS98
+  virtual bool IsWideClient() const { return false; }
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef TYPE_H
+#define TYPE_H
+
+#include <cstdint>
+
+#include "Platform.h"
+
+namespace FSUIPC {
+
+enum class Type {
+  Byte,
+  SByte,
+  Int16,
+  Int32,
+  Int64,
+  UInt16,
+  UInt32,
+  UInt64,
+  Double,
+  Single,
+  ByteArray,
+  String,
+  BitArray,
+};
+
+// Native representation of each fixed-size type. Values in the offset table
+// are little-endian, like the hosts FSUIPC runs on.
+template <Type T>
+struct TypeTraits;
+
+template <>
+struct TypeTraits<Type::Byte> {
+  typedef uint8_t Native;
+};
+template <>
+struct TypeTraits<Type::SByte> {
+  typedef int8_t Native;
+};
+template <>
+struct TypeTraits<Type::Int16> {
+  typedef int16_t Native;
+};
+template <>
+struct TypeTraits<Type::Int32> {
+  typedef int32_t Native;
+};
+template <>
+struct TypeTraits<Type::Int64> {
+  typedef int64_t Native;
+};
+template <>
+struct TypeTraits<Type::UInt16> {
+  typedef uint16_t Native;
+};
+template <>
+struct TypeTraits<Type::UInt32> {
+  typedef uint32_t Native;
+};
+template <>
+struct TypeTraits<Type::UInt64> {
+  typedef uint64_t Native;
+};
+template <>
+struct TypeTraits<Type::Double> {
+  typedef double Native;
+};
+template <>
+struct TypeTraits<Type::Single> {
+  typedef float Native;
+};
+
+template <Type T>
+inline typename TypeTraits<T>::Native Load(const BYTE* data) {
+  typename TypeTraits<T>::Native x;
+  CopyMemory(&x, data, sizeof x);
+  return x;
+}
+
+template <Type T>
+inline void Store(BYTE* data, typename TypeTraits<T>::Native x) {
+  CopyMemory(data, &x, sizeof x);
+}
+
+// Size of the fixed-size types, or 0 for the types that take a size
+inline DWORD get_size_of_type(Type type) {
+  static const DWORD sizes[] = {
+      sizeof(TypeTraits<Type::Byte>::Native),
+      sizeof(TypeTraits<Type::SByte>::Native),
+      sizeof(TypeTraits<Type::Int16>::Native),
+      sizeof(TypeTraits<Type::Int32>::Native),
+      sizeof(TypeTraits<Type::Int64>::Native),
+      sizeof(TypeTraits<Type::UInt16>::Native),
+      sizeof(TypeTraits<Type::UInt32>::Native),
+      sizeof(TypeTraits<Type::UInt64>::Native),
+      sizeof(TypeTraits<Type::Double>::Native),
+      sizeof(TypeTraits<Type::Single>::Native),
+      0,  // ByteArray
+      0,  // String
+      0,  // BitArray
+  };
+
+  if ((unsigned)type > (unsigned)Type::BitArray) {
+    return 0;
+  }
+  return sizes[(unsigned)type];
+}
+
+}  // namespace FSUIPC
+
+#endif
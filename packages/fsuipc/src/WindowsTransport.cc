@@ -0,0 +1,161 @@
+#include "WindowsTransport.h"
+
+#include "Protocol.h"
+
+namespace FSUIPC {
+bool WindowsTransport::Open(Error* result) {
+  char szName[MAX_PATH];
+  static int nTry = 0;
+
+  this->isWideFS = false;
+
+  // Connect via FSUIPC, which is known to be FSUIPC's own
+  // and isn't subject to user modification
+  this->windowHandle = FindWindowEx(nullptr, nullptr, "UIPCMAIN", nullptr);
+  if (!this->windowHandle) {
+    // If there's no UIPCMAIN, we may be using WideClient,
+    // which only simulates FS98
+    this->windowHandle = FindWindowEx(nullptr, nullptr, "FS98MAIN", nullptr);
+    this->isWideFS = true;
+    if (!this->windowHandle) {
+      *result = Error::NOFS;
+      return false;
+    }
+  }
+
+  // Register the window message
+  this->msgId = RegisterWindowMessage(MSGNAME);
+  if (this->msgId == 0) {
+    *result = Error::REGMSG;
+    return false;
+  }
+
+  this->mappings.resize(this->views);
+
+  for (Mapping& mapping : this->mappings) {
+    // Create the name of our file-mapping object
+    nTry++;  // Ensures a unique string is used for every view and reopen
+    wsprintf(szName, "%s:%X:%X", MSGNAME, GetCurrentProcessId(), nTry);
+
+    // Stuff the name into a global atom
+    mapping.atom = GlobalAddAtom(szName);
+    if (mapping.atom == 0) {
+      *result = Error::ATOM;
+      this->Close();
+      return false;
+    }
+
+    // Create the file-mapping object
+    mapping.mapHandle =
+        CreateFileMapping(INVALID_HANDLE_VALUE,  // Use system paging file
+                          nullptr,               // Security
+                          PAGE_READWRITE,        // Protection
+                          0, MAX_SIZE + 256,     // Size
+                          szName                 // Name
+        );
+    if (mapping.mapHandle == 0 || GetLastError() == ERROR_ALREADY_EXISTS) {
+      *result = Error::MAP;
+      this->Close();
+      return false;
+    }
+
+    // Get a view of the file-mapping object
+    mapping.viewPointer =
+        (BYTE*)MapViewOfFile(mapping.mapHandle, FILE_MAP_WRITE, 0, 0, 0);
+    if (mapping.viewPointer == nullptr) {
+      *result = Error::VIEW;
+      this->Close();
+      return false;
+    }
+  }
+
+  *result = Error::OK;
+  return true;
+}
+
+bool WindowsTransport::Available() const {
+  return FindWindowEx(nullptr, nullptr, "UIPCMAIN", nullptr) ||
+         FindWindowEx(nullptr, nullptr, "FS98MAIN", nullptr);
+}
+
+void WindowsTransport::Close() {
+  this->windowHandle = 0;
+  this->msgId = 0;
+
+  for (Mapping& mapping : this->mappings) {
+    if (mapping.atom) {
+      GlobalDeleteAtom(mapping.atom);
+    }
+
+    if (mapping.viewPointer) {
+      UnmapViewOfFile((LPVOID)mapping.viewPointer);
+    }
+
+    if (mapping.mapHandle) {
+      CloseHandle(mapping.mapHandle);
+    }
+  }
+
+  this->mappings.clear();
+}
+
+bool WindowsTransport::Send(unsigned view,
+                            const RetryPolicy& policy,
+                            Error* result) {
+  DWORD_PTR error;
+  ATOM atom = this->mappings[view].atom;
+
+  this->retries = 0;
+
+  // A hung sim can't be interrupted while it has the message, so each
+  // attempt is bounded by the time left until the deadline instead
+  for (unsigned attempt = 0;; attempt++) {
+    *result = policy.Check();
+    if (*result != Error::OK) {
+      return false;
+    }
+
+    if (SendMessageTimeout(
+            this->windowHandle,  // FS6 window handle
+            this->msgId,         // Our registered message id
+            atom,                // wParam: name of file-mapping object
+            0,           // lParam: offset of request into file-mapping object
+            SMTO_BLOCK,  // Halt this thread until we get a response
+            (UINT)policy.AttemptTimeout().count(),  // Time-out interval
+            &error                                  // Return value
+            )) {
+      break;
+    }
+
+    DWORD lastError = GetLastError();
+    if (attempt + 1 >= policy.attempts) {  // Failed all tries?
+      if (lastError == 0) {
+        *result = Error::TIMEOUT;
+      } else if (lastError == 5) {
+        /*
+         * Error code 5 means that we don't have permission to communicate
+         * with any window For more information, see:
+         * https://docs.microsoft.com/en-us/windows/win32/debug/system-error-codes--0-499-
+         */
+        *result = Error::NOPERMISSION;
+      } else {
+        *result = Error::SENDMSG;
+      }
+      return false;
+    }
+
+    this->retries++;
+    if (!policy.Backoff(attempt, result)) {
+      return false;
+    }
+  }
+
+  if (error != FS6IPC_MESSAGE_SUCCESS) {
+    *result = Error::DATA;  // FSUIPC didn't like something in the data
+    return false;
+  }
+
+  *result = Error::OK;
+  return true;
+}
+}  // namespace FSUIPC
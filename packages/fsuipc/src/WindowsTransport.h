@@ -0,0 +1,48 @@
+#ifndef WINDOWSTRANSPORT_H
+#define WINDOWSTRANSPORT_H
+
+#include <windows.h>
+
+#include <vector>
+
+#include "Transport.h"
+
+namespace FSUIPC {
+
+// Talks to FSUIPC or WideClient through a named file mapping and
+// SendMessageTimeout to the UIPCMAIN/FS98MAIN window.
+class WindowsTransport : public Transport {
+ public:
+  explicit WindowsTransport(unsigned views = 2) : views(views) {}
+  ~WindowsTransport() { this->Close(); }
+
+  bool Open(Error* result) override;
+  void Close() override;
+  bool Send(unsigned view, const RetryPolicy& policy, Error* result) override;
+  bool Available() const override;
+
+  unsigned Views() const override { return this->views; }
+  BYTE* View(unsigned view) const override {
+    return this->mappings[view].viewPointer;
+  }
+  bool IsWideClient() const override { return this->isWideFS; }
+  unsigned Retries() const override { return this->retries; }
+
+ protected:
+  struct Mapping {
+    ATOM atom = 0;          // Atom containing name of file-mapping object
+    HANDLE mapHandle = 0;   // Handle of file-mapping object
+    BYTE* viewPointer = 0;  // Pointer to view of file-mapping object
+  };
+
+  unsigned views;
+  HWND windowHandle = 0;  // FS6 window handle
+  UINT msgId = 0;         // Id of registered window message
+  std::vector<Mapping> mappings;
+  bool isWideFS = false;
+  unsigned retries = 0;
+};
+
+}  // namespace FSUIPC
+
+#endif
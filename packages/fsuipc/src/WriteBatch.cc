@@ -0,0 +1,93 @@
+#include "WriteBatch.h"
+
+#include <cstring>
+
+#include "Protocol.h"
+#include "Type.h"
+
+namespace FSUIPC {
+
+const char* BatchErrorToString(BatchError error) {
+  switch (error) {
+    case BatchError::OK:
+      return "Okay";
+    case BatchError::TRUNCATED:
+      return "record runs past the end of the buffer";
+    case BatchError::TYPE:
+      return "unknown type";
+    case BatchError::SIZE:
+      return "invalid size for type";
+    case BatchError::STRING:
+      return "string is not terminated within its size";
+  }
+  return "unknown error";
+}
+
+bool ValidateWriteBatch(const BYTE* data,
+                        size_t length,
+                        size_t* count,
+                        BatchError* error,
+                        size_t* position) {
+  size_t pos = 0;
+  *count = 0;
+
+  while (pos < length) {
+    *position = pos;
+
+    if (length - pos < sizeof(WriteBatchRecord)) {
+      *error = BatchError::TRUNCATED;
+      return false;
+    }
+
+    WriteBatchRecord record;
+    CopyMemory(&record, data + pos, sizeof record);
+    pos += sizeof record;
+
+    if (length - pos < record.size) {
+      *error = BatchError::TRUNCATED;
+      return false;
+    }
+
+    // write() has no encoder for bit arrays either, they are written as bytes
+    if (record.type >= (uint16_t)Type::BitArray) {
+      *error = BatchError::TYPE;
+      return false;
+    }
+
+    Type type = (Type)record.type;
+    DWORD expected = get_size_of_type(type);
+
+    if (record.size == 0 || record.size > MAX_WRITE_SIZE ||
+        (expected != 0 && record.size != expected)) {
+      *error = BatchError::SIZE;
+      return false;
+    }
+
+    if (type == Type::String &&
+        std::memchr(data + pos, 0, record.size) == nullptr) {
+      *error = BatchError::STRING;
+      return false;
+    }
+
+    pos += record.size;
+    (*count)++;
+  }
+
+  *error = BatchError::OK;
+  return true;
+}
+
+void PushWriteBatch(WriteQueue* queue, const BYTE* data, size_t length) {
+  size_t pos = 0;
+
+  while (pos < length) {
+    WriteBatchRecord record;
+    CopyMemory(&record, data + pos, sizeof record);
+    pos += sizeof record;
+
+    queue->Push(record.offset, record.size, data + pos);
+    pos += record.size;
+  }
+}
+
+}  // namespace FSUIPC
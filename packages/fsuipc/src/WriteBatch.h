@@ -0,0 +1,47 @@
+#ifndef WRITEBATCH_H
+#define WRITEBATCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Platform.h"
+#include "Protocol.h"
+#include "WriteQueue.h"
+
+namespace FSUIPC {
+
+#pragma pack(push, 1)
+// Header of each record in a writeBatch() buffer. It is followed by size
+// bytes of payload as they should end up in the offset table, and the next
+// record starts right after the payload. All fields are little-endian.
+struct WriteBatchRecord {
+  uint32_t offset;
+  uint16_t type;
+  uint16_t size;
+};
+#pragma pack(pop)
+
+enum class BatchError {
+  OK,
+  TRUNCATED,  // The header or payload runs past the end of the buffer
+  TYPE,       // Unknown type
+  SIZE,       // Size doesn't match the type, is 0 or too large to send
+  STRING,     // String payload without a terminating 0
+};
+
+const char* BatchErrorToString(BatchError error);
+
+// Checks every record of a batch, so a batch is either queued as a whole or
+// not at all. On failure, position is the byte offset of the bad record.
+bool ValidateWriteBatch(const BYTE* data,
+                        size_t length,
+                        size_t* count,
+                        BatchError* error,
+                        size_t* position);
+
+// Queues the records of a batch that passed ValidateWriteBatch
+void PushWriteBatch(WriteQueue* queue, const BYTE* data, size_t length);
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,80 @@
+#include "WriteInbox.h"
+
+#include "Type.h"
+#include "WriteBatch.h"
+
+namespace FSUIPC {
+
+WriteInbox::~WriteInbox() {
+  Node* node = this->head.exchange(nullptr);
+  while (node) {
+    Node* next = node->next;
+    delete node;
+    node = next;
+  }
+}
+
+std::vector<BYTE> WriteInbox::Record(DWORD offset, DWORD size) {
+  std::vector<BYTE> record(sizeof(WriteBatchRecord) + size, 0);
+
+  WriteBatchRecord header{offset, (uint16_t)Type::ByteArray, (uint16_t)size};
+  CopyMemory(record.data(), &header, sizeof header);
+
+  return record;
+}
+
+std::vector<BYTE> WriteInbox::MaskedRecord(DWORD offset, DWORD size) {
+  std::vector<BYTE> record = Record(offset, size);
+  record.resize(record.size() + size, 0);
+  return record;
+}
+
+BYTE* WriteInbox::Payload(std::vector<BYTE>& record) {
+  return record.data() + sizeof(WriteBatchRecord);
+}
+
+void WriteInbox::Push(std::vector<BYTE> batch) {
+  this->Link(new Node{nullptr, std::move(batch), false});
+}
+
+void WriteInbox::PushMasked(std::vector<BYTE> record) {
+  this->Link(new Node{nullptr, std::move(record), true});
+}
+
+void WriteInbox::Link(Node* node) {
+  node->next = this->head.load(std::memory_order_relaxed);
+
+  while (!this->head.compare_exchange_weak(node->next, node,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+  }
+}
+
+void WriteInbox::Drain(WriteQueue* queue) {
+  Node* node = this->head.exchange(nullptr, std::memory_order_acquire);
+
+  // The list is newest first, so reverse it to keep the order of writes
+  Node* reversed = nullptr;
+  while (node) {
+    Node* next = node->next;
+    node->next = reversed;
+    reversed = node;
+    node = next;
+  }
+
+  while (reversed) {
+    Node* next = reversed->next;
+    if (reversed->masked) {
+      WriteBatchRecord record;
+      CopyMemory(&record, reversed->batch.data(), sizeof record);
+      const BYTE* mask = Payload(reversed->batch);
+      queue->PushMasked(record.offset, record.size, mask, mask + record.size);
+    } else {
+      PushWriteBatch(queue, reversed->batch.data(), reversed->batch.size());
+    }
+    delete reversed;
+    reversed = next;
+  }
+}
+
+}  // namespace FSUIPC
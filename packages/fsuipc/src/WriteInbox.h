@@ -0,0 +1,49 @@
+#ifndef WRITEINBOX_H
+#define WRITEINBOX_H
+
+#include <atomic>
+#include <vector>
+
+#include "Platform.h"
+#include "WriteQueue.h"
+
+namespace FSUIPC {
+
+// Hands writes from any thread to the cycle without a lock. Writes are kept
+// in the writeBatch() format: Push() links a batch into a list with a single
+// compare-and-swap, and Drain() takes the whole list with one exchange, so
+// producers never wait for the cycle or for each other.
+class WriteInbox {
+ public:
+  ~WriteInbox();
+
+  // A batch with a single write of size bytes, whose payload starts at
+  // Payload(). The type of the record is not checked again.
+  static std::vector<BYTE> Record(DWORD offset, DWORD size);
+  // A write of only the bits in a mask, with size bytes of mask at Payload()
+  // followed by size bytes of value
+  static std::vector<BYTE> MaskedRecord(DWORD offset, DWORD size);
+  static BYTE* Payload(std::vector<BYTE>& record);
+
+  // Queues a batch that passed ValidateWriteBatch, or a Record()
+  void Push(std::vector<BYTE> batch);
+  // Queues a MaskedRecord()
+  void PushMasked(std::vector<BYTE> record);
+  // Moves the writes pushed so far into queue, in the order they were pushed
+  void Drain(WriteQueue* queue);
+
+ private:
+  struct Node {
+    Node* next;
+    std::vector<BYTE> batch;
+    bool masked;
+  };
+
+  void Link(Node* node);
+
+  std::atomic<Node*> head{nullptr};
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -0,0 +1,258 @@
+#include "WriteQueue.h"
+
+#include <algorithm>
+
+namespace FSUIPC {
+
+void WriteQueue::Push(DWORD offset, DWORD size, const void* data) {
+  uint64_t key = ((uint64_t)offset << 32) | size;
+  size_t payload;
+
+  auto it = this->keys.find(key);
+  if (it != this->keys.end()) {
+    Entry& previous = this->entries[it->second];
+
+    // Nothing was queued after it, so it can be replaced in place. A masked
+    // write has room for the whole value, so it becomes a plain one.
+    if (it->second + 1 == this->entries.size()) {
+      CopyMemory(&this->pool[previous.payload], data, size);
+      previous.mask = PLAIN;
+      return;
+    }
+
+    // Otherwise it has to move to the end, so it still wins from any
+    // overlapping write queued in between
+    previous.live = false;
+    payload = previous.payload;
+  } else {
+    payload = this->pool.size();
+    this->pool.resize(payload + size);
+  }
+
+  CopyMemory(&this->pool[payload], data, size);
+
+  this->keys[key] = this->entries.size();
+  this->entries.push_back(Entry{offset, size, payload, true, PLAIN});
+}
+
+void WriteQueue::PushMasked(DWORD offset,
+                            DWORD size,
+                            const void* mask,
+                            const void* data) {
+  uint64_t key = ((uint64_t)offset << 32) | size;
+  const BYTE* maskBytes = static_cast<const BYTE*>(mask);
+  const BYTE* dataBytes = static_cast<const BYTE*>(data);
+
+  auto it = this->keys.find(key);
+  if (it != this->keys.end()) {
+    Entry& previous = this->entries[it->second];
+    bool last = it->second + 1 == this->entries.size();
+
+    // A plain write can only take the bits if nothing was queued after it.
+    // Moving it to the end would apply all of its bytes after the writes in
+    // between, so the masked write is queued on its own instead.
+    if (previous.mask != PLAIN || last) {
+      // Only the bits in the mask change, of a plain write as well
+      BYTE* payload = &this->pool[previous.payload];
+      for (DWORD i = 0; i < size; i++) {
+        payload[i] =
+            (payload[i] & ~maskBytes[i]) | (dataBytes[i] & maskBytes[i]);
+      }
+      if (previous.mask != PLAIN) {
+        BYTE* merged = &this->pool[previous.mask];
+        for (DWORD i = 0; i < size; i++) {
+          merged[i] |= maskBytes[i];
+        }
+      }
+
+      // A masked write is moved to the end if anything was queued after it.
+      // Resolve() takes the bits outside its mask from every write before
+      // it, so the writes in between still land.
+      if (!last) {
+        Entry moved = previous;
+        previous.live = false;
+        it->second = this->entries.size();
+        this->entries.push_back(moved);
+      }
+      return;
+    }
+  }
+
+  // The value, the mask and room for the resolved bytes
+  size_t payload = this->pool.size();
+  this->pool.resize(payload + 3 * size);
+  for (DWORD i = 0; i < size; i++) {
+    this->pool[payload + i] = dataBytes[i] & maskBytes[i];
+  }
+  CopyMemory(&this->pool[payload + size], mask, size);
+
+  this->keys[key] = this->entries.size();
+  this->entries.push_back(Entry{offset, size, payload, true, payload + size});
+}
+
+void WriteQueue::Append(const WriteQueue& other) {
+  for (const Entry& entry : other.entries) {
+    if (!entry.live) {
+      continue;
+    }
+
+    if (entry.mask == PLAIN) {
+      this->Push(entry.offset, entry.size, &other.pool[entry.payload]);
+    } else {
+      this->PushMasked(entry.offset, entry.size, &other.pool[entry.mask],
+                       &other.pool[entry.payload]);
+    }
+  }
+}
+
+const BYTE* WriteQueue::Data(const Entry& entry) const {
+  if (entry.mask == PLAIN) {
+    return &this->pool[entry.payload];
+  }
+  return &this->pool[entry.mask + entry.size];
+}
+
+bool WriteQueue::Resolve(IPCUser* ipc, Error* result) {
+  std::vector<size_t> masked;
+  for (size_t i = 0; i < this->entries.size(); i++) {
+    if (this->entries[i].live && this->entries[i].mask != PLAIN) {
+      masked.push_back(i);
+    }
+  }
+
+  *result = Error::OK;
+  if (masked.empty()) {
+    return true;
+  }
+
+  // Read the current bytes into each entry's resolved bytes, spilling into
+  // more transactions when they don't fit in one
+  size_t first = 0;
+  for (size_t k = 0; k < masked.size(); k++) {
+    const Entry& entry = this->entries[masked[k]];
+    if (ipc->Read(entry.offset, entry.size,
+                  &this->pool[entry.mask + entry.size], result)) {
+      continue;
+    }
+
+    if (*result != Error::SIZE || k == first) {
+      ipc->Discard();
+      return false;
+    }
+    if (!ipc->Process(result)) {
+      return false;
+    }
+    first = k--;
+  }
+  if (!ipc->Process(result)) {
+    return false;
+  }
+
+  for (size_t i : masked) {
+    const Entry& entry = this->entries[i];
+    BYTE* resolved = &this->pool[entry.mask + entry.size];
+    DWORD end = entry.offset + entry.size;
+
+    // Writes queued before this one land first, so their bytes are what the
+    // bits outside the mask are kept at
+    for (size_t j = 0; j < i; j++) {
+      const Entry& earlier = this->entries[j];
+      DWORD from = std::max(earlier.offset, entry.offset);
+      DWORD to = std::min(earlier.offset + earlier.size, end);
+      if (earlier.live && from < to) {
+        CopyMemory(resolved + (from - entry.offset),
+                   this->Data(earlier) + (from - earlier.offset), to - from);
+      }
+    }
+
+    const BYTE* mask = &this->pool[entry.mask];
+    const BYTE* payload = &this->pool[entry.payload];
+    for (DWORD b = 0; b < entry.size; b++) {
+      resolved[b] = (resolved[b] & ~mask[b]) | (payload[b] & mask[b]);
+    }
+  }
+
+  return true;
+}
+
+void WriteQueue::Clear() {
+  this->entries.clear();
+  this->pool.clear();
+  this->keys.clear();
+  this->requests.clear();
+}
+
+const std::vector<WriteRequest>& WriteQueue::Compile() {
+  this->requests.clear();
+
+  // Entries in queue order are sorted by offset, keeping that order for
+  // entries at the same offset
+  std::vector<size_t> order;
+  order.reserve(this->keys.size());
+  for (size_t i = 0; i < this->entries.size(); i++) {
+    if (this->entries[i].live) {
+      order.push_back(i);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return this->entries[a].offset < this->entries[b].offset;
+  });
+
+  // Find the runs of overlapping or adjacent writes. Writes separated by a
+  // gap are never merged, as that would overwrite the bytes in between.
+  struct Run {
+    DWORD offset;
+    DWORD size;
+    size_t merged;
+    std::vector<size_t> members;
+  };
+  std::vector<Run> runs;
+  size_t total = 0;
+
+  for (size_t i : order) {
+    const Entry& entry = this->entries[i];
+    DWORD end = entry.offset + entry.size;
+
+    Run* run = runs.empty() ? nullptr : &runs.back();
+    if (run && entry.offset <= run->offset + run->size) {
+      run->size = std::max(run->offset + run->size, end) - run->offset;
+      run->members.push_back(i);
+    } else {
+      runs.push_back(Run{entry.offset, entry.size, 0, {i}});
+    }
+  }
+
+  for (Run& run : runs) {
+    if (run.members.size() > 1) {
+      run.merged = total;
+      total += run.size;
+    }
+  }
+  this->merged.resize(total);
+
+  for (Run& run : runs) {
+    // A single write can be sent from the pool directly
+    if (run.members.size() == 1) {
+      const Entry& entry = this->entries[run.members[0]];
+      this->requests.push_back(WriteRequest{
+          entry.offset, entry.size, const_cast<BYTE*>(this->Data(entry))});
+      continue;
+    }
+
+    BYTE* dest = &this->merged[run.merged];
+
+    // Apply in queue order, so the last write wins where they overlap
+    std::sort(run.members.begin(), run.members.end());
+    for (size_t i : run.members) {
+      const Entry& entry = this->entries[i];
+      CopyMemory(dest + (entry.offset - run.offset), this->Data(entry),
+                 entry.size);
+    }
+
+    this->requests.push_back(WriteRequest{run.offset, run.size, dest});
+  }
+
+  return this->requests;
+}
+
+}  // namespace FSUIPC
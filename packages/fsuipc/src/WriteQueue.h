@@ -0,0 +1,69 @@
+#ifndef WRITEQUEUE_H
+#define WRITEQUEUE_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Cycle.h"
+#include "Platform.h"
+
+namespace FSUIPC {
+
+// Pending writes for the next cycle. Payloads are copied into a pool that is
+// recycled between cycles, and writing the same (offset, size) again replaces
+// the queued payload instead of adding another write.
+//
+// A masked write only changes the bits set in its mask. Masked writes to the
+// same (offset, size) are merged into one, and a masked write right after a
+// plain one is applied to the plain write's payload. The bits outside the
+// mask are read from the sim by Resolve() right before the writes are sent,
+// and taken from any write queued before the masked one.
+class WriteQueue {
+ public:
+  void Push(DWORD offset, DWORD size, const void* data);
+  void PushMasked(DWORD offset, DWORD size, const void* mask, const void* data);
+  // Queues the writes of other after the writes of this queue
+  void Append(const WriteQueue& other);
+  // Drops all writes, keeping the pool's memory
+  void Clear();
+
+  // Reads the current value of the bytes of every masked write in a
+  // transaction of its own and merges the writes into it. Does nothing if no
+  // masked writes are queued. Must succeed before Compile() whenever any are.
+  bool Resolve(IPCUser* ipc, Error* result);
+
+  // Merges overlapping and adjacent writes into single write requests. Where
+  // writes overlap, the last one queued wins. The requests are valid until
+  // the queue is changed.
+  const std::vector<WriteRequest>& Compile();
+
+  bool Empty() const { return this->keys.empty(); }
+
+ protected:
+  static const size_t PLAIN = (size_t)-1;
+
+  struct Entry {
+    DWORD offset;
+    DWORD size;
+    size_t payload;  // Position of the data in the pool
+    bool live;       // False once replaced by a later write
+    // Position of the mask in the pool, followed by the resolved bytes, or
+    // PLAIN for a write of all bits
+    size_t mask;
+  };
+
+  // The bytes an entry writes
+  const BYTE* Data(const Entry& entry) const;
+
+  std::vector<Entry> entries;
+  std::vector<BYTE> pool;
+  std::unordered_map<uint64_t, size_t> keys;  // Live entry of each write
+
+  std::vector<WriteRequest> requests;
+  std::vector<BYTE> merged;
+};
+
+}  // namespace FSUIPC
+
+#endif
@@ -8,6 +8,7 @@ Napi::Object InitModule(Napi::Env env, Napi::Object exports) {
   InitType(env, exports);
   InitError(env, exports);
   InitSimulator(env, exports);
+  InitConnectionState(env, exports);
 
   return exports;
 }
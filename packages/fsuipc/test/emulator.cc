@@ -0,0 +1,302 @@
+// Checks the request encoder, the read plan, the write queue, the size limits
+// of requests and the change tracker against the shared-memory emulator.
+// Built and run by the bench project:
+//
+//   cmake -S bench -B build-bench && cmake --build build-bench
+//   ctest --test-dir build-bench --output-on-failure
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "ChangeTracker.h"
+#include "Cycle.h"
+#include "IPCUser.h"
+#include "ReadPlan.h"
+#include "Registry.h"
+#include "ShmTransport.h"
+#include "WriteBatch.h"
+#include "WriteQueue.h"
+
+using namespace FSUIPC;
+
+static int failures = 0;
+
+#define EXPECT(condition)                                               \
+  do {                                                                  \
+    if (!(condition)) {                                                 \
+      fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__,       \
+              #condition);                                              \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+// An open connection to a fresh emulator, whose table is filled with a
+// pattern from 0x4000 on
+struct Emulator {
+  ShmTransport* transport;
+  IPCUser ipc;
+
+  explicit Emulator(unsigned views = 2)
+      : transport(new ShmTransport(0, views)), ipc(transport) {
+    Error result;
+    if (!this->ipc.Open(Simulator::ANY, &result)) {
+      fprintf(stderr, "open: %s\n", ErrorToString(result));
+      failures++;
+      return;
+    }
+
+    for (DWORD i = 0x4000; i < SHM_TABLE_SIZE; i++) {
+      this->Table()[i] = (BYTE)(i * 7 + 3);
+    }
+  }
+
+  BYTE* Table() { return this->transport->Table(); }
+};
+
+static bool Matches(const Registry& registry, BYTE* table) {
+  for (const Offset& offset : registry.Offsets()) {
+    if (std::memcmp(registry.Data(offset), &table[offset.offset],
+                    offset.size) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void TestReadPlanMergesWithinGap() {
+  Emulator emulator;
+  Registry registry;
+  registry.Add("a", Type::Int32, 0x4000, 4);
+  registry.Add("b", Type::Int16, 0x4006, 2);  // 2 bytes after a
+  registry.Add("c", Type::Int16, 0x4005, 2);  // Overlaps a and b
+  registry.Add("d", Type::Double, 0x4100, 8);
+
+  ReadPlan plan;
+  plan.Build(registry.Targets(), 2);
+  EXPECT(plan.Blocks().size() == 2);
+  EXPECT(plan.Blocks()[0].offset == 0x4000 && plan.Blocks()[0].size == 8);
+
+  Error result;
+  EXPECT(ProcessCycle(&emulator.ipc, {&plan}, {}, &result));
+  EXPECT(Matches(registry, emulator.Table()));
+
+  // Without a gap, a and b are read separately
+  plan.Build(registry.Targets(), 0);
+  EXPECT(plan.Blocks().size() == 3);
+}
+
+static void TestReadPlanSpillsOverTransactions() {
+  for (unsigned views = 1; views <= 2; views++) {
+    Emulator emulator(views);
+    Registry registry;
+    registry.Add("a", Type::ByteArray, 0x4000, 20000);
+    registry.Add("b", Type::ByteArray, 0x9000, 20000);
+    registry.Add("c", Type::ByteArray, 0xE000, 8000);
+
+    ReadPlan plan;
+    plan.Build(registry.Targets(), 16);
+    EXPECT(plan.Frames() >= 2);
+
+    Error result;
+    EXPECT(ProcessCycle(&emulator.ipc, {&plan}, {}, &result));
+    EXPECT(Matches(registry, emulator.Table()));
+  }
+}
+
+static void TestReadPlanNearLastOffset() {
+  // b ends past the last offset, the block still has to cover all of it
+  BYTE a[4], b[16];
+  std::vector<ReadTarget> targets = {{0xFFFFFFF0, sizeof a, a},
+                                     {0xFFFFFFF8, sizeof b, b}};
+
+  ReadPlan plan;
+  plan.Build(targets, 16);
+  EXPECT(plan.Blocks().size() == 1);
+  EXPECT(plan.Blocks()[0].offset == 0xFFFFFFF0 &&
+         plan.Blocks()[0].size == 0x18);
+
+  // A gap that reaches past the last offset still merges
+  targets = {{0xFFFFFF00, sizeof a, a}, {0xFFFFFF80, sizeof a, a}};
+  plan.Build(targets, 0x100);
+  EXPECT(plan.Blocks().size() == 1);
+}
+
+static void TestWriteQueueMerges() {
+  Emulator emulator;
+  WriteQueue queue;
+
+  static const BYTE a[4] = {1, 2, 3, 4};
+  static const BYTE b[4] = {5, 6, 7, 8};
+  static const BYTE c[2] = {9, 10};
+  queue.Push(0x5000, 4, a);
+  queue.Push(0x5002, 4, b);  // Overlaps a, and wins where it does
+  queue.Push(0x5100, 2, c);
+
+  const std::vector<WriteRequest>& writes = queue.Compile();
+  EXPECT(writes.size() == 2);
+  EXPECT(writes[0].offset == 0x5000 && writes[0].size == 6);
+
+  Error result;
+  EXPECT(ProcessCycle(&emulator.ipc, {}, writes, &result));
+
+  static const BYTE merged[6] = {1, 2, 5, 6, 7, 8};
+  EXPECT(std::memcmp(&emulator.Table()[0x5000], merged, 6) == 0);
+  EXPECT(std::memcmp(&emulator.Table()[0x5100], c, 2) == 0);
+}
+
+static void TestWriteQueueReplaces() {
+  WriteQueue queue;
+
+  static const BYTE a[2] = {1, 2};
+  static const BYTE b[2] = {3, 4};
+  static const BYTE c[1] = {5};
+  queue.Push(0x5000, 2, a);
+  queue.Push(0x5001, 1, c);
+  queue.Push(0x5000, 2, b);  // Moves after c, so it still wins
+
+  const std::vector<WriteRequest>& writes = queue.Compile();
+  EXPECT(writes.size() == 1);
+  EXPECT(writes[0].size == 2 && std::memcmp(writes[0].src, b, 2) == 0);
+}
+
+static void TestMaskedWriteKeepsWritesInBetween() {
+  Emulator emulator;
+  WriteQueue queue;
+
+  static const BYTE zero[2] = {0x00, 0x00};
+  static const BYTE high[1] = {0xFF};
+  static const BYTE bit[2] = {0x01, 0x00};
+  queue.Push(0x0D0C, 2, zero);
+  queue.Push(0x0D0D, 1, high);
+  queue.PushMasked(0x0D0C, 2, bit, bit);
+
+  Error result;
+  EXPECT(queue.Resolve(&emulator.ipc, &result));
+  EXPECT(ProcessCycle(&emulator.ipc, {}, queue.Compile(), &result));
+  EXPECT(emulator.Table()[0x0D0C] == 0x01);
+  EXPECT(emulator.Table()[0x0D0D] == 0xFF);
+
+  // Bits outside the mask keep the value they have in the sim
+  static const BYTE mask[1] = {0xF0};
+  static const BYTE value[1] = {0xA5};
+  emulator.Table()[0x5000] = 0x3C;
+  queue.Clear();
+  queue.PushMasked(0x5000, 1, mask, value);
+  EXPECT(queue.Resolve(&emulator.ipc, &result));
+  EXPECT(ProcessCycle(&emulator.ipc, {}, queue.Compile(), &result));
+  EXPECT(emulator.Table()[0x5000] == 0xAC);
+}
+
+static void TestMaximumSizeWrites() {
+  Emulator emulator;
+  Error result;
+
+  // The largest write fits in a transaction of its own, one more byte doesn't
+  std::vector<BYTE> data(MAX_WRITE_SIZE + 1, 0x5A);
+  EXPECT(emulator.ipc.Write(0x4000, MAX_WRITE_SIZE, data.data(), &result));
+  EXPECT(emulator.ipc.Process(&result));
+  EXPECT(emulator.Table()[0x4000 + MAX_WRITE_SIZE - 1] == 0x5A);
+  EXPECT(!emulator.ipc.Write(0x4000, MAX_WRITE_SIZE + 1, data.data(),
+                             &result));
+  EXPECT(result == Error::SIZE);
+  emulator.ipc.Discard();
+
+  // Through the write queue, after reads that fill a transaction
+  Registry registry;
+  registry.Add("a", Type::ByteArray, 0x4000, 30000);
+  ReadPlan plan;
+  plan.Build(registry.Targets(), 16);
+
+  WriteQueue queue;
+  std::fill(data.begin(), data.end(), 0xA5);
+  queue.Push(0x4000, MAX_WRITE_SIZE, data.data());
+  EXPECT(ProcessCycle(&emulator.ipc, {&plan}, queue.Compile(), &result));
+  EXPECT(emulator.Table()[0x4000 + MAX_WRITE_SIZE - 1] == 0xA5);
+
+  // The largest masked write, whose bytes are read first
+  static const BYTE mask[1] = {0x0F};
+  std::vector<BYTE> masks(MAX_READ_SIZE, 0x0F);
+  std::vector<BYTE> values(MAX_READ_SIZE, 0x00);
+  queue.Clear();
+  queue.PushMasked(0x4000, MAX_READ_SIZE, masks.data(), values.data());
+  EXPECT(queue.Resolve(&emulator.ipc, &result));
+  EXPECT(ProcessCycle(&emulator.ipc, {}, queue.Compile(), &result));
+  EXPECT(emulator.Table()[0x4000 + MAX_READ_SIZE - 1] == (0xA5 & ~mask[0]));
+
+  // A batch with a record of the largest size is accepted, bit arrays aren't
+  std::vector<BYTE> batch(sizeof(WriteBatchRecord) + MAX_WRITE_SIZE);
+  WriteBatchRecord record{0x4000, (uint16_t)Type::ByteArray,
+                          (uint16_t)MAX_WRITE_SIZE};
+  std::memcpy(batch.data(), &record, sizeof record);
+  size_t count, position;
+  BatchError error;
+  EXPECT(ValidateWriteBatch(batch.data(), batch.size(), &count, &error,
+                            &position));
+  EXPECT(count == 1);
+
+  record.type = (uint16_t)Type::BitArray;
+  std::memcpy(batch.data(), &record, sizeof record);
+  EXPECT(!ValidateWriteBatch(batch.data(), batch.size(), &count, &error,
+                             &position));
+  EXPECT(error == BatchError::TYPE);
+}
+
+static void TestChangeTrackerFilters() {
+  Registry registry;
+  Handle a = registry.Add("a", Type::Double, 0, 8);
+  Handle b = registry.Add("b", Type::Int32, 8, 4);
+  Handle c = registry.Add("c", Type::Byte, 12, 1);
+
+  std::vector<Filter> filters(3);
+  filters[a].deadband = 1.0;
+  filters[b].minInterval = std::chrono::milliseconds(100);
+  filters[c].maxInterval = std::chrono::milliseconds(50);
+
+  ChangeTracker tracker;
+  std::vector<Handle> changed;
+  Filter::Clock::time_point start = Filter::Clock::now();
+  auto update = [&](int ms) {
+    changed.clear();
+    tracker.Update(registry, filters, start + std::chrono::milliseconds(ms),
+                   &changed);
+    return changed;
+  };
+
+  EXPECT(update(0).size() == 3);
+
+  // a moved less than its deadband, b changed within its interval
+  Store<Type::Double>(registry.Data(*registry.Find(a)), 0.5);
+  Store<Type::Int32>(registry.Data(*registry.Find(b)), 7);
+  EXPECT(update(10).empty());
+
+  // Compared with the reported value, so the drift adds up
+  Store<Type::Double>(registry.Data(*registry.Find(a)), 1.2);
+  EXPECT(update(20) == std::vector<Handle>{a});
+
+  // c is reported again without a change
+  EXPECT(update(60) == std::vector<Handle>{c});
+
+  // b's held back change once its interval has passed
+  EXPECT(update(110) == (std::vector<Handle>{b, c}));
+  EXPECT(update(120).empty());
+}
+
+int main() {
+  TestReadPlanMergesWithinGap();
+  TestReadPlanSpillsOverTransactions();
+  TestReadPlanNearLastOffset();
+  TestWriteQueueMerges();
+  TestWriteQueueReplaces();
+  TestMaskedWriteKeepsWritesInBetween();
+  TestMaximumSizeWrites();
+  TestChangeTrackerFilters();
+
+  if (failures > 0) {
+    fprintf(stderr, "%d expectations failed\n", failures);
+    return 1;
+  }
+  printf("all tests passed\n");
+  return 0;
+}
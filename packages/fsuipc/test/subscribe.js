@@ -0,0 +1,26 @@
+const fsuipc = require('..');
+
+const obj = new fsuipc.FSUIPC();
+
+obj.open()
+    .then((obj) => {
+      obj.add('clockHour', 0x238, fsuipc.Type.Byte);
+      obj.add('clockMinute', 0x239, fsuipc.Type.Byte);
+      obj.add('clockSecond', 0x23A, fsuipc.Type.Byte);
+
+      obj.subscribe({ intervalMs: 100 }, (err, result) => {
+        if (err) {
+          console.error(err);
+          return;
+        }
+
+        console.log(JSON.stringify(result));
+      });
+
+      setTimeout(() => obj.close(), 5000);
+    })
+    .catch((err) => {
+      console.error(err);
+
+      return obj.close();
+    });